@@ -0,0 +1,254 @@
+/* gen.c -- synthetic inputs for the benchmarks.
+ *
+ *      usage: gen kind size [seed]
+ *
+ * Writes about "size" bytes of the given kind to standard output. The output
+ * depends only on the arguments, so runs are reproducible:
+ *
+ *      flat    one huge expression, a+b*c+...
+ *      deep    a single expression nested "size"/8 parentheses deep
+ *      short   many short statements
+ *      longid  statements made of 32-character identifiers, from a
+ *              vocabulary of VOCAB of them
+ *      lexspec a LeX specification with many rules, for chap02/nfa.c
+ *      bytes   raw text for the ii_* input system (no '\0' bytes)
+ *      cols    a column file for vmrun -c (see chap01/batch.h), "size" rows
+ *
+ * Lines are kept short, like those of a program typed by hand.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define LINE 72     /* longest output line */
+#define VOCAB 4096  /* distinct identifiers in longid */
+
+static uint64_t Seed = 1;
+static long Size;       /* bytes wanted */
+static long Written;    /* bytes written so far */
+static int Column;      /* position in the current output line */
+
+static uint64_t rnd(void)
+{
+    /* xorshift64*, the same sequence on every machine */
+    Seed ^= Seed >> 12;
+    Seed ^= Seed << 25;
+    Seed ^= Seed >> 27;
+    return Seed * 2685821657736338717ULL;
+}
+
+static int pick(int n)
+{
+    return (rnd() >> 33) % n;
+}
+
+static void put(char *s)
+{
+    /* Write a token, starting a new line first if it wouldn't fit */
+    int len = strlen(s);
+
+    if (Column > 0 && Column + len > LINE) {
+        putchar('\n');
+        ++Written;
+        Column = 0;
+    }
+    fputs(s, stdout);
+    Written += len;
+    Column += len;
+}
+
+static void newline(void)
+{
+    putchar('\n');
+    ++Written;
+    Column = 0;
+}
+
+static char *ident(int len)
+{
+    /* a random identifier or number of the given length */
+    static char buf[LINE + 1];
+    static char alnum[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    int i;
+
+    buf[0] = pick(4) ? 'a' + pick(26) : '1' + pick(9);
+    for (i = 1; i < len; ++i) {
+        buf[i] = buf[0] <= '9' ? '0' + pick(10) : alnum[pick(36)];
+    }
+    buf[len] = '\0';
+    return buf;
+}
+
+static char *op(void)
+{
+    return pick(2) ? "+" : "*";
+}
+
+static void flat(void)
+{
+    put(ident(1 + pick(3)));
+    while (Written < Size) {
+        put(op());
+        put(ident(1 + pick(3)));
+    }
+    put(";");
+    newline();
+}
+
+static void deep(void)
+{
+    /* ((((a)+b)*c)+d) ... nested to the left, which needs only two
+     * temporaries however deep it goes */
+    long depth = Size / 8, i;
+
+    for (i = 0; i < depth; ++i) {
+        put("(");
+    }
+    put(ident(1));
+    for (i = 0; i < depth; ++i) {
+        put(")");
+        put(op());
+        put(ident(1 + pick(3)));
+    }
+    put(";");
+    newline();
+}
+
+static char Vocab[VOCAB][LINE + 1];
+
+static char *operand(int idlen)
+{
+    return idlen ? Vocab[pick(VOCAB)] : ident(1 + pick(3));
+}
+
+static void statements(int idlen)
+{
+    int n;
+
+    for (n = 0; idlen && n < VOCAB; ++n) {
+        strcpy(Vocab[n], ident(idlen));
+        Vocab[n][0] = 'a' + pick(26);
+    }
+
+    while (Written < Size) {
+        put(operand(idlen));
+        for (n = pick(4); n > 0; --n) {
+            put(op());
+            if (pick(4) == 0) {
+                put("(");
+                put(operand(idlen));
+                put(op());
+                put(operand(idlen));
+                put(")");
+            } else {
+                put(operand(idlen));
+            }
+        }
+        put(";");
+        if (pick(3) == 0) {
+            newline();
+        }
+    }
+    newline();
+}
+
+static void lexspec(void)
+{
+    /* definitions, then rules mixing keywords, classes and closures */
+    static char *pat[] = {
+        "{D}+", "{L}({L}|{D})*", "[a-f0-9]+h", "\"%s\"", "%s{D}*",
+        "(%s|%s)+", "[^\\n]*%s", "%s?[xyz]*",
+    };
+    char word[16], rule[LINE];
+    int n = 0;
+
+    printf("D\t[0-9]\nL\t[a-zA-Z_]\n%%%%\n");
+    Written += 25;
+    while (Written < Size) {
+        strcpy(word, ident(3 + pick(8)));
+        snprintf(rule, sizeof(rule), pat[pick(8)], word, word);
+        Written += printf("%s\treturn %d;\n", rule, ++n);
+    }
+    printf("%%%%\n");
+}
+
+static void bytes(void)
+{
+    /* printable text with a blank at least every 64 bytes so no lexeme
+     * outgrows the input system's buffer */
+    int c, run = 0;
+
+    for (Written = 0; Written < Size; ++Written) {
+        c = pick(8) == 0 ? " \n\t"[pick(3)] : 0x21 + pick(0x7f - 0x21);
+        if (++run >= 64) {
+            c = '\n';
+        }
+        if (c == ' ' || c == '\n' || c == '\t') {
+            run = 0;
+        }
+        putchar(c);
+    }
+}
+
+static void cols(void)
+{
+    /* Size rows of the eight columns "a" through "h" */
+    uint32_t ncols = 8, len = 1;
+    uint64_t nrows = Size, row;
+    int64_t v;
+    char name;
+    int i;
+
+    fwrite("COLS", 4, 1, stdout);
+    fwrite(&ncols, sizeof(ncols), 1, stdout);
+    fwrite(&nrows, sizeof(nrows), 1, stdout);
+    for (i = 0; i < ncols; ++i) {
+        name = 'a' + i;
+        fwrite(&len, sizeof(len), 1, stdout);
+        fwrite(&name, 1, 1, stdout);
+    }
+    for (i = 0; i < ncols; ++i) {
+        for (row = 0; row < nrows; ++row) {
+            v = (int64_t) (rnd() >> 40) - (1 << 23);
+            fwrite(&v, sizeof(v), 1, stdout);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    char *kind;
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: gen flat|deep|short|longid|lexspec|bytes|cols "
+                "size [seed]\n");
+        return 1;
+    }
+    kind = argv[1];
+    Size = strtol(argv[2], NULL, 10);
+    if (argc > 3) {
+        Seed = strtoull(argv[3], NULL, 10) | 1;
+    }
+
+    if (strcmp(kind, "flat") == 0) {
+        flat();
+    } else if (strcmp(kind, "deep") == 0) {
+        deep();
+    } else if (strcmp(kind, "short") == 0) {
+        statements(0);
+    } else if (strcmp(kind, "longid") == 0) {
+        statements(32);
+    } else if (strcmp(kind, "lexspec") == 0) {
+        lexspec();
+    } else if (strcmp(kind, "bytes") == 0) {
+        bytes();
+    } else if (strcmp(kind, "cols") == 0) {
+        cols();
+    } else {
+        fprintf(stderr, "gen: unknown kind %s\n", kind);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+/* harness.c -- time a program over a corpus.
+ *
+ *      usage: harness -H
+ *             harness [-r runs] [-t] [-s states] name corpus command [arg...]
+ *
+ * Runs the command "runs" times with the corpus on standard input and its
+ * output discarded, and prints one tab-separated line: the name, corpus
+ * size, fastest wall-clock time, MB/s, tokens/s (-t counts chap01 tokens in
+ * the corpus), NFA states/s (-s gives the number of states built), peak RSS
+ * and exit status. -H prints the column headings. Rates that don't apply
+ * are "-".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long count_tokens(FILE *fp, long *bytes)
+{
+    /* chap01 tokens: runs of alphanumerics, and ; + * ( ) */
+    long tokens = 0;
+    int c, in_id = 0;
+
+    for (*bytes = 0; (c = getc(fp)) != EOF; ++*bytes) {
+        if (isalnum(c)) {
+            tokens += !in_id;
+            in_id = 1;
+        } else {
+            in_id = 0;
+            tokens += strchr(";+*()", c) != NULL;
+        }
+    }
+    return tokens;
+}
+
+static int run(char *corpus, char **argv, double *secs, long *maxrss)
+{
+    /* Run the command once. Return its wait() status. */
+    struct rusage ru;
+    double start;
+    pid_t pid;
+    int status, fd;
+
+    start = now();
+    if ((pid = fork()) == 0) {
+        if ((fd = open(corpus, O_RDONLY)) < 0) {
+            perror(corpus);
+            _exit(127);
+        }
+        dup2(fd, 0);
+        fd = open("/dev/null", O_WRONLY);
+        dup2(fd, 1);
+        dup2(fd, 2);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    if (pid < 0 || wait4(pid, &status, 0, &ru) < 0) {
+        perror("harness");
+        exit(1);
+    }
+    *secs = now() - start;
+    *maxrss = ru.ru_maxrss;
+    return status;
+}
+
+int main(int argc, char *argv[])
+{
+    int runs = 1, tokens_wanted = 0, i, status;
+    long states = 0, tokens = 0, bytes, rss, maxrss = 0;
+    double secs, best = 0;
+    char *name, *corpus, result[32];
+    FILE *fp;
+
+    if (argc == 2 && strcmp(argv[1], "-H") == 0) {
+        printf("name\tbytes\tseconds\tMB/s\ttokens/s\tstates/s\t"
+               "maxrss_kb\tstatus\n");
+        return 0;
+    }
+
+    for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            tokens_wanted = 1;
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            states = atol(argv[++i]);
+        }
+    }
+    if (argc - i < 3) {
+        fprintf(stderr, "usage: harness [-r runs] [-t] [-s states] "
+                "name corpus command [arg...]\n");
+        return 1;
+    }
+    name = argv[i];
+    corpus = argv[i + 1];
+
+    if ((fp = fopen(corpus, "rb")) == NULL) {
+        perror(corpus);
+        return 1;
+    }
+    tokens = count_tokens(fp, &bytes);
+    fclose(fp);
+
+    strcpy(result, "ok");
+    for (; runs > 0; --runs) {
+        status = run(corpus, &argv[i + 2], &secs, &rss);
+        if (best == 0 || secs < best) {
+            best = secs;
+        }
+        if (rss > maxrss) {
+            maxrss = rss;
+        }
+        if (WIFSIGNALED(status)) {
+            sprintf(result, "signal %d", WTERMSIG(status));
+        } else if (WEXITSTATUS(status) != 0) {
+            sprintf(result, "exit %d", WEXITSTATUS(status));
+        }
+    }
+
+    printf("%s\t%ld\t%.4f\t%.2f\t", name, bytes, best, bytes / best / 1e6);
+    if (tokens_wanted) {
+        printf("%.0f\t", tokens / best);
+    } else {
+        printf("-\t");
+    }
+    if (states) {
+        printf("%.0f\t", states / best);
+    } else {
+        printf("-\t");
+    }
+    printf("%ld\t%s\n", maxrss, result);
+    return 0;
+}
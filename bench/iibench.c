@@ -0,0 +1,126 @@
+/* iibench.c -- drive the chap02 input system over a file the way a lexer
+ * would: every run of non-blank characters is marked as a lexeme.
+ *
+ *      usage: iibench [-v] [-a|-m|-s] [-n] [-r readsize] file
+ *
+ * Prints the number of bytes and lexemes read, and with -v the input
+ * system's statistics. -a has the kernel read the file ahead and -r sets
+ * the size of each read (see ii_config()). With -n the characters are only
+ * read, which times ii_advance() by itself. -m reads the whole file into
+ * memory first and scans it there with ii_newbuffer(); -s reads it through
+ * stdio with ii_newsource(). */
+
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdlib.h>
+#include "input.h"
+
+int Verbose = 0;
+
+static ssize_t stdio_read(void *arg, unsigned char *buf, size_t n)
+{
+    size_t got = fread(buf, 1, n, arg);
+
+    return (got == 0 && ferror((FILE *)arg)) ? -1 : got;
+}
+
+static void stdio_close(void *arg)
+{
+    fclose(arg);
+}
+
+static int open_input(char *name, int how)
+{
+    ii_source_t src = { stdio_read, stdio_close, NULL };
+    unsigned char *buf;
+    long len;
+    FILE *fp;
+
+    if (how == 'f') {
+        return ii_newfile(name);
+    }
+
+    if ((fp = fopen(name, "rb")) == NULL) {
+        return -1;
+    }
+
+    if (how == 's') {
+        src.arg = fp;
+        return ii_newsource(&src);
+    }
+
+    /* room for the sentinel */
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    rewind(fp);
+    if (len < 0 || (buf = malloc(len + 1)) == NULL
+            || fread(buf, 1, len, fp) != len) {
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    return ii_newbuffer(buf, len);
+}
+
+int main(int argc, char *argv[])
+{
+    long bytes = 0, lexemes = 0;
+    int c, in_lexeme = 0, marks = 1, how = 'f';
+    ii_config_t cfg = { 0 };
+
+    for (; argc > 2 && argv[1][0] == '-'; --argc, ++argv) {
+        if (strcmp(argv[1], "-v") == 0) {
+            Verbose = 1;
+        } else if (strcmp(argv[1], "-a") == 0) {
+            ii_readahead(true);
+        } else if (strcmp(argv[1], "-m") == 0) {
+            how = 'm';
+        } else if (strcmp(argv[1], "-s") == 0) {
+            how = 's';
+        } else if (strcmp(argv[1], "-n") == 0) {
+            marks = 0;
+        } else if (strcmp(argv[1], "-r") == 0) {
+            cfg.readsize = strtoul(argv[2], NULL, 0);
+            --argc;
+            ++argv;
+        } else {
+            break;
+        }
+    }
+
+    if (argc != 2 || ii_config(&cfg) < 0 || open_input(argv[1], how) < 0) {
+        fprintf(stderr,
+                "usage: iibench [-v] [-a|-m|-s] [-n] [-r readsize] file\n");
+        return 1;
+    }
+
+    while (!marks && (c = ii_advance()) > 0) {
+        ++bytes;
+    }
+
+    while (marks && (c = ii_advance()) > 0) {
+        ++bytes;
+        if (isspace(c)) {
+            if (in_lexeme) {
+                ii_mark_end();
+                ++lexemes;
+            }
+            ii_mark_start();
+            in_lexeme = 0;
+        } else {
+            in_lexeme = 1;
+        }
+    }
+
+    lexemes += in_lexeme;
+
+    if (c < 0) {
+        fprintf(stderr, "iibench: lexeme too long at byte %ld\n", bytes);
+        return 1;
+    }
+
+    printf("%ld bytes, %ld lexemes\n", bytes, lexemes);
+    return 0;
+}
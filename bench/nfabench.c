@@ -0,0 +1,58 @@
+/* nfabench.c -- build the NFA of every rule of a LeX specification with the
+ * chap02 regular-expression compiler.
+ *
+ *      usage: nfabench < spec
+ *
+ * The definitions before the first %% become macros. Each rule after it, up
+ * to the next %%, has its expression (the text before the first blank) made
+ * into a machine of its own by nfa_compile(), with the same parser and
+ * Thompson construction thompson() uses for each rule; thompson() would
+ * also save the actions and chain the rules together, which this leaves out.
+ * Prints the number of NFA states made, for harness -s; exits with 1 if a
+ * rule doesn't compile. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/set.h"
+#include "nfa.h"
+#define ALLOC
+#include "globals.h"
+
+int main(void)
+{
+    char line[256];
+    const char *err;
+    nfa_state *nfa, *start, *end;
+    long states = 0;
+    int n, section = 0;
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        if (strcmp(line, "%%") == 0) {
+            if (++section == 2) {
+                break;
+            }
+            continue;
+        }
+        if (*line == '\0') {
+            continue;
+        }
+        if (section == 0) {
+            new_macro(line);
+            continue;
+        }
+
+        line[strcspn(line, " \t")] = '\0';
+        if ((nfa = nfa_compile(line, &n, &start, &end, &err)) == NULL) {
+            fprintf(stderr, "nfabench: %s: %s\n", line, err);
+            return 1;
+        }
+        states += n;
+        nfa_free(nfa, n);
+    }
+
+    printf("%ld\n", states);
+    return 0;
+}
@@ -1,14 +1,12 @@
 /* Revised parser */
 
 #include <stdio.h>
-#include <stdarg.h>
 #include <stdbool.h>
 #include "lex.h"
 
 void *factor(char *tempvar);
 void *term(char *tempvar);
 void *expression(char *tempvar);
-bool legal_lookahead(token_t first_arg,...);
 extern char *newname(void);
 extern void freename(char *name);
 
@@ -85,55 +83,3 @@ void *factor(char *tempvar)
         fprintf(stderr, "%d: Number of identifier expected\n", yylineno);
     }
 }
-
-#define MAXFIRST 16
-#define SYNCH   SEMI
-bool legal_lookahead(token_t first_arg,...)
-{
-    /* simple error detection and recovery. Arguments are a 0-terminated list
-     * of those token that can legitimately come next in the input. If the
-     * list is empty, the end of file must come next. Print an error message
-     * if necessary. Error recovery is performed by discarding all input
-     * symboals until one that's in the input list is found
-     *
-     * Return treu if there's no error or if we recovered from the error,
-     * false if we can't recover.
-     */
-    va_list args;
-    token_t tok;
-    token_t lookaheads[MAXFIRST], *p = lookaheads, *current;
-    int error_printed = 0;
-    int ret_val = 0;
-
-    va_start(args, first_arg);
-
-    if (! first_arg) {
-        if (match(EOF)) {
-            ret_val = true;
-        }
-    } else {
-        *p++ = first_arg;
-        while ((tok = va_arg(args, token_t)) && p < &lookaheads[MAXFIRST]) {
-            *++p = tok;
-        }
-        while (!match(SYNCH)) {
-            for(current = lookaheads; current < p; ++current) {
-                if (match(*current)) {
-                    ret_val = true;
-                    goto exit;
-                }
-            }
-
-            if (! error_printed) {
-                fprintf(stderr, "Line %d: Syntax error\n", yylineno);
-                error_printed = 1;
-            }
-
-            advance();
-        }
-    }
-
-exit:
-    va_end(args);
-    return ret_val;
-}
@@ -0,0 +1,265 @@
+/* Column-at-a-time evaluation of bytecode programs.
+ *
+ * The rows are processed in blocks of BLOCK. For each block the program runs
+ * once, and every instruction is a loop (kernel) over the block, so the
+ * dispatch cost is spread over BLOCK rows and the loops vectorize. The
+ * kernels use AVX2 when the processor has it. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include "vm.h"
+#include "batch.h"
+
+#define BLOCK 1024      /* rows per pass over the program */
+
+/*-----------------------------------------------------------------------------
+ * Kernels: out[i] = a[i] op b[i]. out may be a or b.
+ *---------------------------------------------------------------------------*/
+static void add_scalar(value_t *out, value_t *a, value_t *b, int n)
+{
+    int i;
+    for (i = 0; i < n; ++i) {
+        out[i] = a[i] + b[i];
+    }
+}
+
+static void mul_scalar(value_t *out, value_t *a, value_t *b, int n)
+{
+    int i;
+    for (i = 0; i < n; ++i) {
+        out[i] = a[i] * b[i];
+    }
+}
+
+static void (*Add)(value_t *, value_t *, value_t *, int) = add_scalar;
+static void (*Mul)(value_t *, value_t *, value_t *, int) = mul_scalar;
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(NO_AVX2)
+#include <immintrin.h>
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static void add_avx2(value_t *out, value_t *a, value_t *b, int n)
+{
+    __m256i x, y;
+    int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        x = _mm256_loadu_si256((__m256i *) &a[i]);
+        y = _mm256_loadu_si256((__m256i *) &b[i]);
+        _mm256_storeu_si256((__m256i *) &out[i], _mm256_add_epi64(x, y));
+    }
+    add_scalar(&out[i], &a[i], &b[i], n - i);
+}
+
+AVX2 static void mul_avx2(value_t *out, value_t *a, value_t *b, int n)
+{
+    /* AVX2 has no 64-bit multiply. With a = ah:al and b = bh:bl in 32-bit
+     * halves, the low 64 bits of a*b are al*bl + ((al*bh + ah*bl) << 32). */
+    __m256i x, y, lo, cross, hi;
+    int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        x = _mm256_loadu_si256((__m256i *) &a[i]);
+        y = _mm256_loadu_si256((__m256i *) &b[i]);
+        lo = _mm256_mul_epu32(x, y);
+        cross = _mm256_mullo_epi32(x, _mm256_shuffle_epi32(y, 0xb1));
+        hi = _mm256_add_epi32(cross, _mm256_srli_epi64(cross, 32));
+        hi = _mm256_slli_epi64(hi, 32);
+        _mm256_storeu_si256((__m256i *) &out[i], _mm256_add_epi64(lo, hi));
+    }
+    mul_scalar(&out[i], &a[i], &b[i], n - i);
+}
+
+static void pick_kernels(void)
+{
+    if (__builtin_cpu_supports("avx2")) {
+        Add = add_avx2;
+        Mul = mul_avx2;
+    }
+}
+#else
+static void pick_kernels(void)
+{
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+ * The evaluator. A register is a pointer to BLOCK values. LOADV just points
+ * it at the variable's column, so input is never copied; the first operation
+ * on such a register writes into the register's own buffer instead.
+ *---------------------------------------------------------------------------*/
+void batch_run(program_t *prog, value_t **vars, long nrows,
+               value_t **results)
+{
+    static value_t own[NREGS][BLOCK];
+    static int first_time = 1;
+    static value_t zero[BLOCK];
+    value_t *r[NREGS];
+    value_t **res;
+    insn_t *ip;
+    long row;
+    int n, i;
+
+    if (first_time) {
+        pick_kernels();
+        first_time = 0;
+    }
+
+    for (row = 0; row < nrows; row += BLOCK) {
+        n = nrows - row < BLOCK ? nrows - row : BLOCK;
+        res = results;
+
+        for (i = 0; i < NREGS; ++i) {
+            r[i] = zero;        /* never loaded: reads as 0, as in vm_run() */
+        }
+
+        for (ip = prog->code; ip->op != OP_HALT; ++ip) {
+            switch (ip->op) {
+                case OP_LOADK:
+                    r[ip->dst] = own[ip->dst];
+                    for (i = 0; i < n; ++i) {
+                        r[ip->dst][i] = prog->consts[ip->src];
+                    }
+                    break;
+                case OP_LOADV:
+                    r[ip->dst] = vars[ip->src] + row;
+                    break;
+                case OP_ADD:
+                    (*Add)(own[ip->dst], r[ip->dst], r[ip->src], n);
+                    r[ip->dst] = own[ip->dst];
+                    break;
+                case OP_MUL:
+                    (*Mul)(own[ip->dst], r[ip->dst], r[ip->src], n);
+                    r[ip->dst] = own[ip->dst];
+                    break;
+                case OP_RESULT:
+                    memcpy(*res++ + row, r[ip->dst], n * sizeof(value_t));
+                    break;
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Column files
+ *---------------------------------------------------------------------------*/
+void cols_free(columns_t *cols)
+{
+    /* Free what cols_read() allocated, also after it failed part way. */
+    int i;
+
+    for (i = 0; i < cols->ncols; ++i) {
+        if (cols->names) {
+            free(cols->names[i]);
+        }
+        if (cols->data) {
+            free(cols->data[i]);
+        }
+    }
+    free(cols->names);
+    free(cols->data);
+    cols->names = NULL;
+    cols->data = NULL;
+    cols->ncols = 0;
+    cols->nrows = 0;
+}
+
+int cols_read(char *path, columns_t *cols)
+{
+    FILE *fp;
+    char magic[4];
+    uint32_t ncols, len, i;
+    uint64_t nrows;
+
+    cols->ncols = 0;
+    cols->nrows = 0;
+    cols->names = NULL;
+    cols->data = NULL;
+
+    if ((fp = fopen(path, "rb")) == NULL) {
+        return -1;
+    }
+    errno = 0;
+
+    if (fread(magic, 4, 1, fp) != 1 || memcmp(magic, "COLS", 4) != 0
+            || fread(&ncols, sizeof(ncols), 1, fp) != 1
+            || fread(&nrows, sizeof(nrows), 1, fp) != 1) {
+        goto bad;
+    }
+
+    /* the counts come from the file, make sure the sizes below can't wrap */
+    if (ncols > INT_MAX || nrows > LONG_MAX
+            || nrows > (SIZE_MAX - 1) / sizeof(value_t)) {
+        errno = EFBIG;
+        goto bad;
+    }
+
+    cols->names = calloc(ncols + 1, sizeof(char *));
+    cols->data = calloc(ncols + 1, sizeof(value_t *));
+    if (cols->names == NULL || cols->data == NULL) {
+        goto bad;
+    }
+    cols->ncols = ncols;
+    cols->nrows = nrows;
+
+    for (i = 0; i < ncols; ++i) {
+        if (fread(&len, sizeof(len), 1, fp) != 1 || len == UINT32_MAX
+                || (cols->names[i] = malloc(len + 1)) == NULL
+                || fread(cols->names[i], 1, len, fp) != len) {
+            goto bad;
+        }
+        cols->names[i][len] = '\0';
+    }
+
+    for (i = 0; i < ncols; ++i) {
+        cols->data[i] = malloc(nrows * sizeof(value_t) + 1);
+        if (cols->data[i] == NULL
+                || fread(cols->data[i], sizeof(value_t), nrows, fp) != nrows) {
+            goto bad;
+        }
+    }
+
+    fclose(fp);
+    return 0;
+
+bad:
+    if (errno == 0 || feof(fp)) {
+        errno = EINVAL;         /* not a column file, or a truncated one */
+    }
+    cols_free(cols);
+    fclose(fp);
+    return -1;
+}
+
+int cols_write(char *path, columns_t *cols)
+{
+    FILE *fp;
+    uint32_t ncols = cols->ncols, len, i;
+    uint64_t nrows = cols->nrows;
+    int ok;
+
+    if ((fp = fopen(path, "wb")) == NULL) {
+        return -1;
+    }
+
+    ok = fwrite("COLS", 4, 1, fp) == 1
+      && fwrite(&ncols, sizeof(ncols), 1, fp) == 1
+      && fwrite(&nrows, sizeof(nrows), 1, fp) == 1;
+
+    for (i = 0; ok && i < ncols; ++i) {
+        len = strlen(cols->names[i]);
+        ok = fwrite(&len, sizeof(len), 1, fp) == 1
+          && fwrite(cols->names[i], 1, len, fp) == len;
+    }
+
+    for (i = 0; ok && i < ncols; ++i) {
+        ok = fwrite(cols->data[i], sizeof(value_t), nrows, fp) == nrows;
+    }
+
+    return (fclose(fp) == 0 && ok) ? 0 : -1;
+}
@@ -0,0 +1,26 @@
+/* batch.h -- evaluate a bytecode program over columns of values.
+ *
+ * Each variable slot has a column of nrows values and each statement gets a
+ * column of nrows results, so one pass over the program serves a whole
+ * block of rows.
+ *
+ * Column files hold, in native byte order:
+ *
+ *      "COLS", uint32 ncols, uint64 nrows,
+ *      ncols names, each a uint32 length followed by that many bytes,
+ *      ncols columns of nrows int64 values, one column after another.
+ */
+
+typedef struct {
+    int ncols;
+    long nrows;
+    char **names;
+    value_t **data;     /* data[i] is the column called names[i] */
+} columns_t;
+
+int cols_read(char *path, columns_t *cols);   /* -1 on error, see errno */
+int cols_write(char *path, columns_t *cols);
+void cols_free(columns_t *cols);
+
+void batch_run(program_t *prog, value_t **vars, long nrows,
+               value_t **results);
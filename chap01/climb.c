@@ -0,0 +1,163 @@
+/* Operator-precedence parser. Generates the same code as retval.c, but
+ * expressions are parsed with explicit operator and operand stacks instead
+ * of recursion, so parentheses can nest as deeply as memory allows. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "lex.h"
+#include "code.h"
+
+char *expression(void);
+extern char *newname(void);
+extern void freename(char *name);
+extern bool match(token_t token);
+extern void advance(void);
+
+static token_t *Ops = NULL;     /* operator stack: PLUS, TIMES or LP */
+static int Op_sp = 0;           /* # of operators on the stack       */
+static int Op_size = 0;         /* # of slots allocated              */
+
+static char **Vals = NULL;      /* operand stack: temporary names    */
+static int Val_sp = 0;
+static int Val_size = 0;
+
+int Nerrors = 0;                /* # of syntax errors reported       */
+
+static void *grow(void *stack, int *size, size_t elsize)
+{
+    /* Double the size of a stack, both stacks grow with the nesting depth of
+     * the expression, not with its length. */
+    *size = *size ? *size * 2 : 64;
+    stack = realloc(stack, *size * elsize);
+    if (stack == NULL) {
+        fprintf(stderr, "%d: Expression too deeply nested\n", yylineno);
+        exit(1);
+    }
+    return stack;
+}
+
+static void push_op(token_t tok)
+{
+    if (Op_sp >= Op_size) {
+        Ops = grow(Ops, &Op_size, sizeof(*Ops));
+    }
+    Ops[Op_sp++] = tok;
+}
+
+static void push_val(char *name)
+{
+    if (Val_sp >= Val_size) {
+        Vals = grow(Vals, &Val_size, sizeof(*Vals));
+    }
+    Vals[Val_sp++] = name;
+}
+
+static int prec(token_t tok)
+{
+    /* binding power of an operator. LP is lowest so nothing reduces past it */
+    return tok == TIMES ? 2 : tok == PLUS ? 1 : 0;
+}
+
+static void reduce(void)
+{
+    /* Pop an operator and its right operand, emitting code that leaves the
+     * result in the left operand (which stays on the stack). */
+    token_t op = Ops[--Op_sp];
+    char *right = Vals[--Val_sp];
+    char *left = Vals[Val_sp - 1];
+
+    gen_op(op, left, right);
+    freename(right);
+}
+
+void statements(void)
+{
+    /* statements -> expression SEMI | expression SEMI statements */
+    char *tempvar;
+    while (! match(EOI)) {
+        tempvar = expression();
+
+        if (match(SEMI)) {
+            advance();
+        } else {
+            fprintf(stderr, "%d: Inserting missing semicolon\n", yylineno);
+            ++Nerrors;
+        }
+
+        gen_result(tempvar);
+        freename(tempvar);
+    }
+}
+
+char *expression(void)
+{
+    /* expression -> term (PLUS term)*
+     * term       -> factor (TIMES factor)*
+     * factor     -> NUM_OR_ID | LP expression RP
+     *
+     * Operands and operators alternate. Before an operator is pushed, every
+     * operator of the same or higher precedence above the innermost LP is
+     * reduced; an RP reduces down to its LP. The code comes out in the same
+     * order, and with the same temporaries, as the recursive version.
+     */
+    char *tempvar;
+    int depth = 0;      /* # of LPs on the operator stack */
+    token_t tok;
+
+    while (true) {
+        /* operand: any number of LPs followed by a NUM_OR_ID */
+        while (match(LP)) {
+            push_op(LP);
+            ++depth;
+            advance();
+        }
+
+        if (match(NUM_OR_ID)) {
+            gen_load(tempvar = newname(), yytext, yyleng);
+            advance();
+        } else {
+            fprintf(stderr, "%d: Number of identifier expected\n", yylineno);
+            ++Nerrors;
+            tempvar = newname();    /* a placeholder, never loaded: like
+                                       retval, print nothing for it, and
+                                       vmrun won't run a program with
+                                       errors */
+        }
+        push_val(tempvar);
+
+        /* operator: close any groups that end here, then PLUS or TIMES */
+        while (depth > 0 && match(RP)) {
+            while (Ops[Op_sp - 1] != LP) {
+                reduce();
+            }
+            --Op_sp;
+            --depth;
+            advance();
+        }
+
+        if (match(PLUS) || match(TIMES)) {
+            tok = match(PLUS) ? PLUS : TIMES;
+            while (Op_sp > 0 && prec(Ops[Op_sp - 1]) >= prec(tok)) {
+                reduce();
+            }
+            push_op(tok);
+            advance();
+        } else {
+            break;
+        }
+    }
+
+    /* end of expression, unclosed groups are reported innermost first */
+    while (Op_sp > 0) {
+        if (Ops[Op_sp - 1] == LP) {
+            fprintf(stderr, "%d: Mismatched parenthesis\n", yylineno);
+            ++Nerrors;
+            --Op_sp;
+        } else {
+            reduce();
+        }
+    }
+
+    return Vals[--Val_sp];
+}
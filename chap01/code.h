@@ -0,0 +1,9 @@
+/* code.h -- code-generation back ends.
+ *
+ * The parsers describe the code they generate with these calls, and the back
+ * end that's linked in decides what to do with it: text.c prints it, vm.c
+ * assembles it into bytecode. Operands are temporaries from newname(). */
+
+void gen_load(char *dst, char *text, int len);  /* dst = NUM_OR_ID lexeme */
+void gen_op(token_t op, char *dst, char *src);  /* dst += src, dst *= src */
+void gen_result(char *src);     /* end of statement, its value is in src */
@@ -0,0 +1,31 @@
+/* expr.g -- the chap01 expression grammar, input to llgen.
+ *
+ * Terminals are numbered in the order they're listed, which must match
+ * token_t in lex.h; the first one marks end of input. The first nonterminal
+ * is the goal symbol. {name} is an action: act_name() is called when the
+ * parser gets to it. An action that precedes a terminal runs while that
+ * terminal is still the lookahead symbol, so yytext is valid.
+ */
+%term EOI SEMI PLUS TIMES LP RP NUM_OR_ID
+%%
+statements  : expression SEMI {stmt} statements
+            | /* epsilon */
+            ;
+
+expression  : term expr_prime
+            ;
+
+expr_prime  : PLUS term {add} expr_prime
+            | /* epsilon */
+            ;
+
+term        : factor term_prime
+            ;
+
+term_prime  : TIMES factor {mul} term_prime
+            | /* epsilon */
+            ;
+
+factor      : {load} NUM_OR_ID
+            | LP expression RP
+            ;
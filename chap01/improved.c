@@ -1,7 +1,6 @@
 /* Revised parser */
 
 #include <stdio.h>
-#include <stdarg.h>
 #include <stdbool.h>
 #include "lex.h"
 
@@ -10,14 +9,23 @@
 void factor(void);
 void term(void);
 void expression(void);
-bool legal_lookahead(token_t first_arg,...);
+extern bool legal_lookahead(tokset_t legal, tokset_t follow);
 
 void statements(void)
 {
-    /* statements -> expression SEMI | expression SEMI statements */
+    /* statements -> expression SEMI | expression SEMI statements
+     *
+     * expression() stops at a token in its FOLLOW set without taking it. A
+     * ")" here has no "(" to close, and nothing else would take it either, so
+     * it's thrown away to keep the parser moving. */
     while (! match(EOI)) {
         expression();
 
+        while (match(RP)) {
+            fprintf(stderr, "%d: Mismatched parenthesis\n", yylineno);
+            advance();
+        }
+
         if (match(SEMI)) {
             advance();
         } else {
@@ -30,7 +38,7 @@ void expression(void)
 {
     /* expression -> term expression'
      * expression' -> PLUS term expression' | epsilon */
-    if (! legal_lookahead(NUM_OR_ID, LP, 0)) {
+    if (! legal_lookahead(FIRST_EXPR, FOLLOW_EXPR)) {
         return;
     }
 
@@ -47,7 +55,7 @@ void term(void)
      * term' -> TIMES factor term'
      *       |  epsilon
      */
-    if (! legal_lookahead(NUM_OR_ID, LP, 0)) {
+    if (! legal_lookahead(FIRST_TERM, FOLLOW_TERM)) {
         return;
     }
 
@@ -63,7 +71,7 @@ void factor(void)
     /* factor -> NUM_OR_ID
      *        |  LP expression RP
      */
-    if (! legal_lookahead(NUM_OR_ID, LP, 0)) {
+    if (! legal_lookahead(FIRST_FACTOR, FOLLOW_FACTOR)) {
         return;
     }
 
@@ -82,55 +90,3 @@ void factor(void)
     }
 
 }
-
-#define MAXFIRST 16
-#define SYNCH   SEMI
-bool legal_lookahead(token_t first_arg,...)
-{
-    /* simple error detection and recovery. Arguments are a 0-terminated list
-     * of those token that can legitimately come next in the input. If the
-     * list is empty, the end of file must come next. Print an error message
-     * if necessary. Error recovery is performed by discarding all input
-     * symboals until one that's in the input list is found
-     *
-     * Return treu if there's no error or if we recovered from the error,
-     * false if we can't recover.
-     */
-    va_list args;
-    token_t tok;
-    token_t lookaheads[MAXFIRST], *p = lookaheads, *current;
-    int error_printed = 0;
-    int ret_val = 0;
-
-    va_start(args, first_arg);
-
-    if (! first_arg) {
-        if (match(EOF)) {
-            ret_val = true;
-        }
-    } else {
-        *p++ = first_arg;
-        while ((tok = va_arg(args, token_t)) && p < &lookaheads[MAXFIRST]) {
-            *++p = tok;
-        }
-        while (!match(SYNCH)) {
-            for(current = lookaheads; current < p; ++current) {
-                if (match(*current)) {
-                    ret_val = true;
-                    goto exit;
-                }
-            }
-
-            if (! error_printed) {
-                fprintf(stderr, "Line %d: Syntax error\n", yylineno);
-                error_printed = 1;
-            }
-
-            advance();
-        }
-    }
-
-exit:
-    va_end(args);
-    return ret_val;
-}
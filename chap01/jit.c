@@ -0,0 +1,151 @@
+/* x86-64 code generator for the bytecode in vm.h.
+ *
+ * Each instruction becomes one or two machine instructions. The temporaries
+ * live in registers, vars arrives in rdi and results in rsi (System V
+ * calling convention), and the code is written into an mmap()ed region that
+ * is made executable once it's complete. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm.h"
+#include "jit.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+
+#include <sys/mman.h>
+
+#define MAXINSN 14      /* longest translation of one instruction */
+
+#define RBX 3
+#define RSI 6
+#define RDI 7
+
+/* machine register holding each temporary; rbx is callee-saved */
+static const unsigned char Reg[NREGS] = { 0, 1, 2, RBX, 8, 9, 10, 11 };
+
+static unsigned char *Pc;   /* where the next byte of code goes */
+
+static void rex(int reg, int rm)
+{
+    /* REX.W prefix, with the high bits of the two register fields */
+    *Pc++ = 0x48 | ((reg & 8) >> 1) | ((rm & 8) >> 3);
+}
+
+static void modrm(int mod, int reg, int rm)
+{
+    *Pc++ = (mod << 6) | ((reg & 7) << 3) | (rm & 7);
+}
+
+static void imm(unsigned long val, int nbytes)
+{
+    while (--nbytes >= 0) {     /* little endian */
+        *Pc++ = val & 0xff;
+        val >>= 8;
+    }
+}
+
+static void translate(insn_t *ip, value_t *consts)
+{
+    int dst = Reg[ip->dst];
+    int src;
+    value_t k;
+
+    switch (ip->op) {
+        case OP_LOADK:
+            k = consts[ip->src];
+            if (k == (int) k) {
+                rex(0, dst);                /* mov dst, imm32 */
+                *Pc++ = 0xc7;
+                modrm(3, 0, dst);
+                imm(k, 4);
+            } else {
+                rex(0, dst);                /* movabs dst, imm64 */
+                *Pc++ = 0xb8 + (dst & 7);
+                imm(k, 8);
+            }
+            break;
+        case OP_LOADV:
+            rex(dst, RDI);                  /* mov dst, [rdi + 8*src] */
+            *Pc++ = 0x8b;
+            modrm(2, dst, RDI);
+            imm(ip->src * sizeof(value_t), 4);
+            break;
+        case OP_ADD:
+            src = Reg[ip->src];
+            rex(src, dst);                  /* add dst, src */
+            *Pc++ = 0x01;
+            modrm(3, src, dst);
+            break;
+        case OP_MUL:
+            src = Reg[ip->src];
+            rex(dst, src);                  /* imul dst, src */
+            *Pc++ = 0x0f;
+            *Pc++ = 0xaf;
+            modrm(3, dst, src);
+            break;
+        case OP_RESULT:
+            rex(dst, RSI);                  /* mov [rsi], dst */
+            *Pc++ = 0x89;
+            modrm(0, dst, RSI);
+            rex(0, RSI);                    /* add rsi, 8 */
+            *Pc++ = 0x83;
+            modrm(3, 0, RSI);
+            *Pc++ = sizeof(value_t);
+            break;
+        case OP_HALT:
+            *Pc++ = 0x5b;                   /* pop rbx */
+            *Pc++ = 0xc3;                   /* ret     */
+            break;
+    }
+}
+
+jit_fn jit_compile(program_t *prog)
+{
+    size_t size = prog->ncode * MAXINSN + 1;
+    unsigned char *code;
+    insn_t *ip;
+
+    code = mmap(NULL, size + sizeof(size_t), PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        return NULL;
+    }
+
+    /* the mapping's size goes in front of the code, for jit_free() */
+    *(size_t *) code = size + sizeof(size_t);
+    Pc = code + sizeof(size_t);
+
+    *Pc++ = 0x53;                           /* push rbx */
+    for (ip = prog->code; ip < &prog->code[prog->ncode]; ++ip) {
+        translate(ip, prog->consts);
+    }
+
+    if (mprotect(code, size + sizeof(size_t), PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, size + sizeof(size_t));
+        return NULL;
+    }
+    return (jit_fn) (code + sizeof(size_t));
+}
+
+void jit_free(jit_fn fn)
+{
+    unsigned char *code = (unsigned char *) fn - sizeof(size_t);
+
+    if (fn) {
+        munmap(code, *(size_t *) code);
+    }
+}
+
+#else   /* no code generator for this machine */
+
+jit_fn jit_compile(program_t *prog)
+{
+    return NULL;
+}
+
+void jit_free(jit_fn fn)
+{
+}
+
+#endif
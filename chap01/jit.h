@@ -0,0 +1,10 @@
+/* jit.h -- translate a bytecode program to native code.
+ *
+ * The compiled function does exactly what vm_run(prog, vars, results) does.
+ * jit_compile() returns NULL when there's no code generator for the host
+ * machine (only x86-64 for now), in which case use vm_run(). */
+
+typedef void (*jit_fn)(value_t *vars, value_t *results);
+
+jit_fn jit_compile(program_t *prog);
+void jit_free(jit_fn fn);
@@ -0,0 +1,47 @@
+/* Error detection and recovery for the expression parsers */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "lex.h"
+
+extern void advance(void);
+
+bool legal_lookahead(tokset_t legal, tokset_t follow)
+{
+    /* Simple error detection and recovery. "legal" is the set of tokens that
+     * can legitimately come next in the input, "follow" the set of tokens
+     * that can follow the nonterminal being recognized. If "legal" is empty,
+     * the end of file must come next. Print an error message if necessary.
+     * Error recovery is performed by discarding input symbols until one
+     * that's in "legal", "follow" or SYNCH_SET is found; each discarded
+     * symbol costs a single set test. Stopping at a FOLLOW token lets the
+     * caller carry on, so "(+ a)" resynchronizes on the ")" instead of
+     * throwing the rest of the statement away.
+     *
+     * Return true if there's no error or if we recovered from the error,
+     * false if we stopped at a synchronizing or following token instead.
+     */
+    bool error_printed = false;
+
+    if (! legal) {
+        legal = TOKBIT(EOI);
+    }
+
+    while (! match_set(legal)) {
+        if (match_set(follow | SYNCH_SET)) {
+            if (! error_printed) {
+                fprintf(stderr, "Line %d: Syntax error\n", yylineno);
+            }
+            return false;
+        }
+
+        if (! error_printed) {
+            fprintf(stderr, "Line %d: Syntax error\n", yylineno);
+            error_printed = true;
+        }
+
+        advance();
+    }
+
+    return true;
+}
@@ -1,5 +1,6 @@
 #include "lex.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <ctype.h>
 #include <stdbool.h>
 
@@ -9,7 +10,8 @@ int yylineno = 0;    /* input line number             */
 
 token_t lex(void)
 {
-    static char input_buffer[128];
+    static char *input_buffer = NULL;  /* grown by getline() to fit a line */
+    static size_t size = 0;
     char *current;
 
     current = yytext + yyleng;  /* skip current lexeme */
@@ -17,13 +19,15 @@ token_t lex(void)
     while (true) {
         while (*current == '\0') {
             /* Get new lines, skipping any leading white space on the line until a
-             * nonblank line is found. 
+             * nonblank line is found. The line may be moved by getline(), so
+             * yytext is left pointing at an empty string at the end.
              */ 
-            current = input_buffer;
-            if (!gets(input_buffer)) {
-                *current = '\0';
+            if (getline(&input_buffer, &size, stdin) < 0) {
+                yytext = "";
+                yyleng = 0;
                 return EOI;
             }
+            current = input_buffer;
             ++yylineno;
             while (isspace(*current)) {
                 ++current;
@@ -96,3 +100,25 @@ void advance()
     /* Advance the lookahead to the next input symbol. */
     Lookahead = lex();
 }
+
+int match_set(tokset_t set)
+{
+    /* Return nonzero if the current lookahead symbol is in "set" */
+
+    if (Lookahead == UNKNOWN) {
+        Lookahead = lex();
+    }
+
+    return TOKBIT(Lookahead) & set;
+}
+
+token_t lookahead(void)
+{
+    /* Return the current lookahead symbol */
+
+    if (Lookahead == UNKNOWN) {
+        Lookahead = lex();
+    }
+
+    return Lookahead;
+}
@@ -12,3 +12,23 @@ typedef enum {
 extern char *yytext;    /* in lex.c */
 extern int yyleng;
 extern int yylineno;
+
+/* Token sets: bit vectors indexed by token_t. The FIRST and FOLLOW sets of
+ * the expression grammar are constants, so a legality check is a single AND.
+ * The three FIRST sets happen to be equal in this grammar (every expression
+ * and term begins with a factor); they're kept separate so that each parser
+ * function names the set it actually means.
+ */
+typedef unsigned int tokset_t;
+
+#define TOKBIT(t)       (1u << (t))
+#define FIRST_FACTOR    (TOKBIT(NUM_OR_ID) | TOKBIT(LP))
+#define FIRST_TERM      FIRST_FACTOR
+#define FIRST_EXPR      FIRST_TERM
+#define FOLLOW_EXPR     (TOKBIT(SEMI) | TOKBIT(RP))
+#define FOLLOW_TERM     (FOLLOW_EXPR | TOKBIT(PLUS))
+#define FOLLOW_FACTOR   (FOLLOW_TERM | TOKBIT(TIMES))
+#define SYNCH_SET       (TOKBIT(SEMI) | TOKBIT(EOI))   /* panic-mode stops */
+
+int match_set(tokset_t set);    /* in lex.c */
+token_t lookahead(void);
@@ -0,0 +1,65 @@
+/* Code-generation actions for expr.g. They generate the same code as
+ * retval.c, through the back end in code.h; the values returned up the call
+ * chain there live on an explicit stack of temporary names here. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "lex.h"
+#include "llparse.h"
+#include "code.h"
+
+extern char *newname(void);
+extern void freename(char *name);
+
+#define VSIZE 16    /* more than the number of temporaries in name.c */
+
+static char *Vstack[VSIZE];     /* value stack, top at Vstack[Vsp-1] */
+static int Vsp = 0;
+
+static void vpush(char *name)
+{
+    if (Vsp >= VSIZE) {
+        fprintf(stderr, "%d: (Internal error) Value stack overflow\n",
+                yylineno);
+        exit(1);
+    }
+    Vstack[Vsp++] = name;
+}
+
+void act_load(void)
+{
+    /* factor -> {load} NUM_OR_ID, NUM_OR_ID is still the lookahead */
+    char *tempvar;
+
+    gen_load(tempvar = newname(), yytext, yyleng);
+    vpush(tempvar);
+}
+
+void act_add(void)
+{
+    char *tempvar2 = Vstack[--Vsp];
+
+    gen_op(PLUS, Vstack[Vsp - 1], tempvar2);
+    freename(tempvar2);
+}
+
+void act_mul(void)
+{
+    char *tempvar2 = Vstack[--Vsp];
+
+    gen_op(TIMES, Vstack[Vsp - 1], tempvar2);
+    freename(tempvar2);
+}
+
+void act_stmt(void)
+{
+    gen_result(Vstack[Vsp - 1]);
+    freename(Vstack[--Vsp]);
+}
+
+void yy_reset(void)
+{
+    while (Vsp > 0) {
+        freename(Vstack[--Vsp]);
+    }
+}
@@ -0,0 +1,78 @@
+/* Table-driven LL(1) parser. The grammar and the code generation live in the
+ * tables llgen makes from expr.g and in the action functions (llact.c);
+ * this driver only walks an explicit symbol stack. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "lex.h"
+#include "llparse.h"
+
+extern bool match(token_t token);
+extern void advance(void);
+
+static short *Stack = NULL;     /* parse stack, top at Stack[Sp-1] */
+static int Sp = 0;
+static int Ssize = 0;
+
+static void push(short sym)
+{
+    if (Sp >= Ssize) {
+        Ssize = Ssize ? Ssize * 2 : 64;
+        Stack = realloc(Stack, Ssize * sizeof(*Stack));
+        if (Stack == NULL) {
+            fprintf(stderr, "%d: Parse stack overflow\n", yylineno);
+            exit(1);
+        }
+    }
+    Stack[Sp++] = sym;
+}
+
+void statements(void)
+{
+    /* Parse the whole input. A terminal on top of the stack must match the
+     * lookahead, a nonterminal is replaced by the right-hand side the table
+     * picks for the lookahead, and an action is called.
+     *
+     * A missing terminal is reported and assumed inserted. An illegal
+     * lookahead for a nonterminal discards input up to and including the
+     * next SEMI, then restarts from the goal symbol. */
+    int first_act = Yy_nterm + Yy_nnonterm;
+    short sym;
+    int prod, i;
+
+    push(Yy_start);
+    while (Sp > 0) {
+        sym = Stack[--Sp];
+
+        if (sym < Yy_nterm) {
+            if (match(sym)) {
+                advance();
+            } else {
+                fprintf(stderr, "%d: Inserting missing %s\n", yylineno,
+                        Yy_names[sym]);
+            }
+        } else if (sym >= first_act) {
+            (*Yy_act[sym - first_act])();
+        } else {
+            prod = Yy_table[(sym - Yy_nterm) * Yy_nterm + lookahead()];
+            if (prod != YY_ERR) {
+                for (i = Yy_prod[prod]; i < Yy_prod[prod + 1]; ++i) {
+                    push(Yy_rhs[i]);
+                }
+                continue;
+            }
+
+            fprintf(stderr, "%d: Syntax error\n", yylineno);
+            while (! match_set(SYNCH_SET)) {
+                advance();
+            }
+            if (match(SEMI)) {
+                advance();
+            }
+            yy_reset();
+            Sp = 0;
+            push(Yy_start);
+        }
+    }
+}
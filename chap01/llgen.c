@@ -0,0 +1,427 @@
+/* llgen.c -- LL(1) parse-table generator.
+ *
+ * Reads a grammar (see expr.g for the format), computes FIRST and FOLLOW
+ * sets, and writes the C tables described in llparse.h to standard output.
+ *
+ *      usage: llgen [grammar]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+
+#define MAXTERM     64      /* terminals fit in one set_t          */
+#define MAXNONTERM  128
+#define MAXACT      128
+#define MAXPROD     256
+#define MAXRHS      32
+#define MAXNAME     64
+
+/* Right-hand-side symbols are encoded by range until the tables are written
+ * out, when nonterminals and actions are renumbered to follow the
+ * terminals. */
+#define NT_BASE     MAXTERM
+#define ACT_BASE    (MAXTERM + MAXNONTERM)
+#define ISTERM(s)   ((s) < NT_BASE)
+#define ISNONTERM(s) ((s) >= NT_BASE && (s) < ACT_BASE)
+
+typedef unsigned long long set_t;   /* set of terminals */
+
+typedef struct {
+    int lhs;            /* nonterminal index          */
+    int rhs[MAXRHS];    /* encoded symbols            */
+    int len;
+} PROD;
+
+static char Terms[MAXTERM][MAXNAME];
+static int Nterm = 0;
+static char Nonterms[MAXNONTERM][MAXNAME];
+static int Nnonterm = 0;
+static bool Defined[MAXNONTERM];    /* has at least one production */
+static char Acts[MAXACT][MAXNAME];
+static int Nact = 0;
+static PROD Prods[MAXPROD];
+static int Nprod = 0;
+
+static set_t First[MAXNONTERM];
+static bool Nullable[MAXNONTERM];
+static set_t Follow[MAXNONTERM];
+static short Table[MAXNONTERM][MAXTERM];
+
+static FILE *Input;
+static int Lineno = 1;
+
+static void error(char *msg, char *arg)
+{
+    fprintf(stderr, "llgen: line %d: %s %s\n", Lineno, msg, arg ? arg : "");
+    exit(1);
+}
+
+/*-----------------------------------------------------------------------------
+ * Grammar input
+ *---------------------------------------------------------------------------*/
+typedef enum {
+    G_EOF, G_NAME, G_ACTION, G_COLON, G_OR, G_SEMI, G_TERM, G_SEP,
+} GTOKEN;
+
+static char Text[MAXNAME];  /* lexeme of G_NAME or G_ACTION */
+
+static GTOKEN gettok(void)
+{
+    /* Return the next token of the grammar file, skipping white space and
+     * C comments */
+    int c, i;
+
+    while (true) {
+        c = getc(Input);
+        if (c == '\n') {
+            ++Lineno;
+        } else if (c == '/') {
+            if ((c = getc(Input)) != '*') {
+                error("stray", "/");
+            }
+            for (c = getc(Input); c != EOF; c = getc(Input)) {
+                if (c == '\n') {
+                    ++Lineno;
+                } else if (c == '*') {
+                    if ((c = getc(Input)) == '/') {
+                        break;
+                    }
+                    ungetc(c, Input);
+                }
+            }
+        } else if (!isspace(c)) {
+            break;
+        }
+    }
+
+    switch (c) {
+        case EOF: return G_EOF;
+        case ':': return G_COLON;
+        case '|': return G_OR;
+        case ';': return G_SEMI;
+        case '%':
+            if ((c = getc(Input)) == '%') {
+                return G_SEP;
+            }
+            for (i = 0; isalpha(c) && i < MAXNAME - 1; c = getc(Input)) {
+                Text[i++] = c;
+            }
+            ungetc(c, Input);
+            Text[i] = '\0';
+            if (strcmp(Text, "term")) {
+                error("unknown directive %", Text);
+            }
+            return G_TERM;
+        case '{':
+            for (i = 0; (c = getc(Input)) != '}'; ) {
+                if (c == EOF || c == '\n' || i >= MAXNAME - 1) {
+                    error("bad action", NULL);
+                }
+                Text[i++] = c;
+            }
+            Text[i] = '\0';
+            return G_ACTION;
+        default:
+            if (!isalpha(c) && c != '_') {
+                Text[0] = c;
+                Text[1] = '\0';
+                error("illegal character", Text);
+            }
+            for (i = 0; isalnum(c) || c == '_' || c == '\''; c = getc(Input)) {
+                if (i >= MAXNAME - 1) {
+                    error("name too long", NULL);
+                }
+                Text[i++] = c;
+            }
+            ungetc(c, Input);
+            Text[i] = '\0';
+            return G_NAME;
+    }
+}
+
+static int lookup(char names[][MAXNAME], int n, char *name)
+{
+    int i;
+    for (i = 0; i < n; ++i) {
+        if (strcmp(names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int symbol(char *name)
+{
+    /* Return the encoded symbol for a name, adding new nonterminals */
+    int i;
+
+    if ((i = lookup(Terms, Nterm, name)) >= 0) {
+        return i;
+    }
+    if ((i = lookup(Nonterms, Nnonterm, name)) < 0) {
+        if (Nnonterm >= MAXNONTERM) {
+            error("too many nonterminals", NULL);
+        }
+        strcpy(Nonterms[i = Nnonterm++], name);
+    }
+    return NT_BASE + i;
+}
+
+static int action(char *name)
+{
+    int i;
+    if ((i = lookup(Acts, Nact, name)) < 0) {
+        if (Nact >= MAXACT) {
+            error("too many actions", NULL);
+        }
+        strcpy(Acts[i = Nact++], name);
+    }
+    return ACT_BASE + i;
+}
+
+static void read_grammar(void)
+{
+    /* grammar  -> %term NAME... %% rule...
+     * rule     -> NAME : alt (| alt)* ;
+     * alt      -> (NAME | {action})*
+     */
+    GTOKEN tok;
+    int lhs;
+    PROD *p;
+
+    if (gettok() != G_TERM) {
+        error("grammar must start with %term", NULL);
+    }
+    while ((tok = gettok()) == G_NAME) {
+        if (Nterm >= MAXTERM) {
+            error("too many terminals", NULL);
+        }
+        strcpy(Terms[Nterm++], Text);
+    }
+    if (tok != G_SEP || Nterm == 0) {
+        error("expected terminals then %%", NULL);
+    }
+
+    while ((tok = gettok()) != G_EOF) {
+        if (tok != G_NAME || ISTERM(lhs = symbol(Text))) {
+            error("expected nonterminal, got", Text);
+        }
+        if (gettok() != G_COLON) {
+            error("expected : after", Text);
+        }
+        Defined[lhs - NT_BASE] = true;
+
+        do {
+            if (Nprod >= MAXPROD) {
+                error("too many productions", NULL);
+            }
+            p = &Prods[Nprod++];
+            p->lhs = lhs - NT_BASE;
+            p->len = 0;
+            while ((tok = gettok()) == G_NAME || tok == G_ACTION) {
+                if (p->len >= MAXRHS) {
+                    error("right-hand side too long", NULL);
+                }
+                p->rhs[p->len++] = tok == G_NAME ? symbol(Text) : action(Text);
+            }
+        } while (tok == G_OR);
+
+        if (tok != G_SEMI) {
+            error("expected ; or | in rule for", Nonterms[lhs - NT_BASE]);
+        }
+    }
+
+    if (Nprod == 0) {
+        error("no productions", NULL);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * FIRST and FOLLOW sets, parse table
+ *---------------------------------------------------------------------------*/
+static set_t first_of(int *rhs, int len, bool *nullable)
+{
+    /* FIRST of a symbol string. *nullable is set if it can derive epsilon.
+     * Actions derive epsilon. */
+    set_t set = 0;
+    int i;
+
+    for (i = 0; i < len; ++i) {
+        if (ISTERM(rhs[i])) {
+            set |= 1ULL << rhs[i];
+            break;
+        } else if (ISNONTERM(rhs[i])) {
+            set |= First[rhs[i] - NT_BASE];
+            if (!Nullable[rhs[i] - NT_BASE]) {
+                break;
+            }
+        }
+    }
+    *nullable = (i == len);
+    return set;
+}
+
+static void make_sets(void)
+{
+    bool changed, nullable;
+    set_t set;
+    PROD *p;
+    int i, nt;
+
+    do {    /* FIRST and nullable */
+        changed = false;
+        for (p = Prods; p < &Prods[Nprod]; ++p) {
+            set = First[p->lhs] | first_of(p->rhs, p->len, &nullable);
+            if (set != First[p->lhs] || (nullable && !Nullable[p->lhs])) {
+                First[p->lhs] = set;
+                Nullable[p->lhs] |= nullable;
+                changed = true;
+            }
+        }
+    } while (changed);
+
+    Follow[0] = 1ULL << 0;  /* end of input follows the goal symbol */
+    do {
+        changed = false;
+        for (p = Prods; p < &Prods[Nprod]; ++p) {
+            for (i = 0; i < p->len; ++i) {
+                if (!ISNONTERM(p->rhs[i])) {
+                    continue;
+                }
+                nt = p->rhs[i] - NT_BASE;
+                set = first_of(&p->rhs[i + 1], p->len - i - 1, &nullable);
+                if (nullable) {
+                    set |= Follow[p->lhs];
+                }
+                if ((Follow[nt] | set) != Follow[nt]) {
+                    Follow[nt] |= set;
+                    changed = true;
+                }
+            }
+        }
+    } while (changed);
+}
+
+static void make_table(void)
+{
+    bool nullable;
+    set_t set;
+    int p, nt, t;
+
+    for (nt = 0; nt < Nnonterm; ++nt) {
+        if (!Defined[nt]) {
+            error("no productions for", Nonterms[nt]);
+        }
+        for (t = 0; t < Nterm; ++t) {
+            Table[nt][t] = -1;
+        }
+    }
+
+    for (p = 0; p < Nprod; ++p) {
+        set = first_of(Prods[p].rhs, Prods[p].len, &nullable);
+        if (nullable) {
+            set |= Follow[Prods[p].lhs];
+        }
+        for (t = 0; t < Nterm; ++t) {
+            if (!(set & (1ULL << t))) {
+                continue;
+            }
+            nt = Prods[p].lhs;
+            if (Table[nt][t] != -1) {
+                fprintf(stderr, "llgen: grammar is not LL(1): %s has two "
+                        "productions on %s\n", Nonterms[nt], Terms[t]);
+                exit(1);
+            }
+            Table[nt][t] = p;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Output
+ *---------------------------------------------------------------------------*/
+static int renumber(int sym)
+{
+    return ISTERM(sym) ? sym
+         : ISNONTERM(sym) ? Nterm + sym - NT_BASE
+         : Nterm + Nnonterm + sym - ACT_BASE;
+}
+
+static void write_tables(char *grammar)
+{
+    int i, j, off;
+
+    printf("/* Generated by llgen from %s. Do not edit. */\n\n", grammar);
+    printf("#include \"llparse.h\"\n\n");
+    for (i = 0; i < Nact; ++i) {
+        printf("extern void act_%s(void);\n", Acts[i]);
+    }
+
+    printf("\nconst int Yy_nterm = %d;\n", Nterm);
+    printf("const int Yy_nnonterm = %d;\n", Nnonterm);
+    printf("const int Yy_start = %d;\n\n", Nterm);
+
+    printf("const short Yy_table[] = {\n");
+    for (i = 0; i < Nnonterm; ++i) {
+        printf("    /* %-12s */", Nonterms[i]);
+        for (j = 0; j < Nterm; ++j) {
+            printf(" %2d,", Table[i][j]);
+        }
+        printf("\n");
+    }
+    printf("};\n\n");
+
+    printf("const short Yy_prod[] = {\n   ");
+    for (i = off = 0; i < Nprod; off += Prods[i++].len) {
+        printf(" %d,", off);
+    }
+    printf(" %d\n};\n\n", off);
+
+    printf("const short Yy_rhs[] = {\n");
+    for (i = 0; i < Nprod; ++i) {
+        printf("    /* %2d */", i);
+        for (j = Prods[i].len; --j >= 0; ) {
+            printf(" %d,", renumber(Prods[i].rhs[j]));
+        }
+        printf("\n");
+    }
+    printf("    0   /* keeps the array nonempty */\n};\n\n");
+
+    printf("const char *const Yy_names[] = {\n");
+    for (i = 0; i < Nterm; ++i) {
+        printf("    \"%s\",\n", Terms[i]);
+    }
+    for (i = 0; i < Nnonterm; ++i) {
+        printf("    \"%s\",\n", Nonterms[i]);
+    }
+    for (i = 0; i < Nact; ++i) {
+        printf("    \"{%s}\",\n", Acts[i]);
+    }
+    printf("};\n\n");
+
+    printf("void (*const Yy_act[])(void) = {\n");
+    for (i = 0; i < Nact; ++i) {
+        printf("    act_%s,\n", Acts[i]);
+    }
+    printf("    0\n};\n");
+}
+
+int main(int argc, char *argv[])
+{
+    char *grammar = argc > 1 ? argv[1] : "stdin";
+
+    Input = argc > 1 ? fopen(argv[1], "r") : stdin;
+    if (Input == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    read_grammar();
+    make_sets();
+    make_table();
+    write_tables(grammar);
+    return 0;
+}
@@ -0,0 +1,20 @@
+/* llparse.h -- tables emitted by llgen, as used by the driver in lldrive.c.
+ *
+ * Symbols are numbered terminals first (0 .. Yy_nterm-1, the token_t
+ * values), then nonterminals, then actions. */
+
+#define YY_ERR  (-1)    /* Yy_table entry for an illegal lookahead */
+
+extern const int Yy_nterm;          /* # of terminals                  */
+extern const int Yy_nnonterm;       /* # of nonterminals               */
+extern const int Yy_start;          /* goal symbol                     */
+extern const short Yy_table[];      /* [nonterm][term] -> production   */
+extern const short Yy_prod[];       /* production p's right-hand side
+                                       is Yy_rhs[Yy_prod[p]] up to
+                                       Yy_rhs[Yy_prod[p+1]], reversed  */
+extern const short Yy_rhs[];
+extern const char *const Yy_names[];    /* printable symbol names      */
+extern void (*const Yy_act[])(void);    /* action functions            */
+
+/* supplied along with the action functions */
+void yy_reset(void);    /* discard attributes after a syntax error */
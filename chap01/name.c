@@ -2,22 +2,37 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-char *Names[] = {"t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7"};
-char **Namep = Names;
+/* The temporaries t0, t1, ... are made as they're first needed, so an
+ * expression can need any number of them. Names[Namep..Nnames) are free,
+ * the ones before Namep in use. */
+static char **Names = NULL;
+static int Namep = 0;
+static int Nnames = 0;
+static int Nalloc = 0;
 
 char *newname(void)
 {
-    if (Namep >= &Names[sizeof(Names)/sizeof(*Names)]) {
-        fprintf(stderr, "%d: Expression too complex\n", yylineno);
-        exit(1);
+    char *name;
+
+    if (Namep >= Nnames) {
+        if (Nnames >= Nalloc) {
+            Nalloc = Nalloc ? Nalloc * 2 : 8;
+            Names = realloc(Names, Nalloc * sizeof(*Names));
+        }
+        if (Names == NULL || (name = malloc(16)) == NULL) {
+            fprintf(stderr, "%d: Expression too complex\n", yylineno);
+            exit(1);
+        }
+        sprintf(name, "t%d", Nnames);
+        Names[Nnames++] = name;
     }
-    return (*Namep++);
+    return Names[Namep++];
 }
 
 void freename(char *s)
 {
-    if (Namep > Names) {
-        *--Namep = s;
+    if (Namep > 0) {
+        Names[--Namep] = s;
     } else {
         fprintf(stderr, "%d: (Internal error) Name stack underflow\n", yylineno);
     }
@@ -0,0 +1,184 @@
+/* pmain.c: a main() that parses one input in parallel. Link it in place of
+ * main.o with any of the parsers.
+ *
+ *      usage: pretval [-j jobs] < statements
+ *
+ * The input is cut into "jobs" chunks, each ending with a line whose last
+ * nonblank character is a semicolon, so every chunk starts at the beginning
+ * of a statement. Each chunk is parsed by statements() in a child process
+ * with its own lexer, parser and name pool, and with yylineno starting where
+ * the chunk does. The children's standard output and error go to temporary
+ * files that are copied out in input order.
+ *
+ * A chunk that parsed cleanly (no diagnostics, exit status 0) leaves the
+ * parser as it found it, at the start of a statement with every name
+ * freed. Error recovery can leave it in any state, so from the first chunk
+ * that didn't parse cleanly to the end of the input is parsed again here,
+ * serially. The output is therefore always the same as with main.o. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "lex.h"
+
+extern void statements(void);
+
+typedef struct {
+    char *start;        /* first character of the chunk  */
+    long len;
+    int lines;          /* lines before the chunk        */
+    FILE *out, *err;    /* the child's stdout and stderr */
+    pid_t pid;
+    int status;
+} chunk_t;
+
+static char *slurp(int fd, long *len)
+{
+    /* Read all of fd into memory */
+    long size = 65536;
+    char *buf = malloc(size);
+    ssize_t got;
+
+    for (*len = 0; buf; *len += got) {
+        if (*len == size && (buf = realloc(buf, size *= 2)) == NULL) {
+            break;
+        }
+        if ((got = read(fd, buf + *len, size - *len)) <= 0) {
+            return got < 0 ? NULL : buf;
+        }
+    }
+
+    fprintf(stderr, "pmain: Out of memory\n");
+    exit(1);
+}
+
+static char *boundary(char *p, char *end)
+{
+    /* Return the start of the first line at or after p that follows a line
+     * ending with a semicolon, or end if there is none. */
+    char *last = NULL;      /* last nonblank character of the line */
+
+    for (; p < end; ++p) {
+        if (*p == '\n') {
+            if (last && *last == ';') {
+                return p + 1;
+            }
+            last = NULL;
+        } else if (!isspace((unsigned char)*p)) {
+            last = p;
+        }
+    }
+    return end;
+}
+
+static void redirect_stdin(char *start, long len)
+{
+    /* Make the "len" characters at "start" the standard input */
+    FILE *fp = tmpfile();
+
+    if (fp == NULL || fwrite(start, 1, len, fp) != len || fflush(fp) != 0) {
+        perror("pmain");
+        exit(1);
+    }
+    rewind(fp);
+    dup2(fileno(fp), 0);
+    fclose(fp);
+    clearerr(stdin);
+}
+
+static void copy(FILE *from, FILE *to)
+{
+    char buf[8192];
+    size_t n;
+
+    rewind(from);
+    while ((n = fread(buf, 1, sizeof(buf), from)) > 0) {
+        fwrite(buf, 1, n, to);
+    }
+    fclose(from);
+}
+
+int main(int argc, char *argv[])
+{
+    int jobs = sysconf(_SC_NPROCESSORS_ONLN), nchunks, lines = 0, i;
+    chunk_t *chunks;
+    char *input, *p, *end, *next;
+    long len;
+
+    if (argc == 3 && strcmp(argv[1], "-j") == 0) {
+        jobs = atoi(argv[2]);
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: %s [-j jobs] < statements\n", argv[0]);
+        return 1;
+    }
+
+    if (jobs <= 1) {
+        statements();
+        return 0;
+    }
+
+    if ((input = slurp(0, &len)) == NULL) {
+        perror("pmain");
+        return 1;
+    }
+
+    /* Cut the input into chunks of roughly len / jobs characters */
+    chunks = calloc(jobs, sizeof(chunk_t));
+    end = input + len;
+    for (nchunks = 0, p = input; p < end; ++nchunks, p = next) {
+        next = (nchunks == jobs - 1) ? end : boundary(p + len / jobs, end);
+        chunks[nchunks].start = p;
+        chunks[nchunks].len = next - p;
+        chunks[nchunks].lines = lines;
+        for (; p < next; ++p) {
+            lines += (*p == '\n');
+        }
+    }
+
+    fflush(stdout);
+    for (i = 0; i < nchunks; ++i) {
+        chunk_t *c = &chunks[i];
+
+        if ((c->out = tmpfile()) == NULL || (c->err = tmpfile()) == NULL) {
+            perror("pmain");
+            return 1;
+        }
+        if ((c->pid = fork()) == 0) {
+            redirect_stdin(c->start, c->len);
+            dup2(fileno(c->out), 1);
+            dup2(fileno(c->err), 2);
+            yylineno = c->lines;
+            statements();
+            exit(0);
+        }
+    }
+
+    for (i = 0; i < nchunks; ++i) {
+        if (chunks[i].pid < 0 || waitpid(chunks[i].pid, &chunks[i].status,
+                                         0) < 0) {
+            chunks[i].status = -1;
+        }
+    }
+
+    for (i = 0; i < nchunks; ++i) {
+        chunk_t *c = &chunks[i];
+
+        if (c->status != 0 || ftell(c->err) != 0) {
+            break;
+        }
+        copy(c->out, stdout);
+    }
+
+    if (i < nchunks) {
+        /* chunk i didn't parse cleanly, carry on from there serially */
+        fflush(stdout);
+        redirect_stdin(chunks[i].start, end - chunks[i].start);
+        yylineno = chunks[i].lines;
+        statements();
+    }
+
+    return 0;
+}
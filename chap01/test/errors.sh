@@ -0,0 +1,60 @@
+#!/bin/sh
+# errors.sh -- checks of the parsers on malformed input: each must get to the
+# end of the input and stop; and on input deeper or longer than their old
+# fixed limits. Prints the checks that fail; exits with 1 if any
+# did. Run from chap01 by "make test".
+
+failed=0
+
+# Each input is run through a program with a time limit; looping forever on
+# it is the failure.
+finishes()
+{
+    if ! printf "$2" | timeout 5 ./$1 > /dev/null 2>&1; then
+        echo "errors: $1 doesn't finish on '$2'"
+        failed=$((failed + 1))
+    fi
+}
+
+# climb is a drop-in for retval: after a syntax error it mustn't print code
+# for the missing operand, only loads of the operands that are there
+no_placeholder()
+{
+    if printf "$1" | ./climb 2> /dev/null | grep -q '= 0$'; then
+        echo "errors: climb prints a load of 0 for '$1'"
+        failed=$((failed + 1))
+    fi
+}
+
+for input in 'a + ;\n' '(a * ) + b ;\n' '+ ;\n' 'a * (b + ) ;\n'; do
+    no_placeholder "$input"
+    finishes climb "$input"
+done
+
+for input in 'a ) ;\n' ') ;\n' '(a + ) ; b ;\n' 'a ) ) b ;\n' '( a ;\n' \
+             '+ ;\n' '* ) + ;\n'; do
+    finishes improved "$input"
+done
+
+# One line of a+(a+(a+ ... )) 1000 deep: longer than the 128-byte line lex.c
+# once had, and needing a temporary for each level where name.c had 8. The
+# VM has only 8 registers, so vmrun must refuse it rather than misbehave.
+deep=$(awk 'BEGIN { for (i = 0; i < 1000; i++) printf "a+("; printf "a";
+                    for (i = 0; i < 1000; i++) printf ")"; print ";" }')
+for prog in retval climb; do
+    if ! echo "$deep" | ./$prog 2>&1 | grep -q 't999 = a$'; then
+        echo "errors: $prog doesn't nest 1000 deep"
+        failed=$((failed + 1))
+    fi
+done
+if echo "$deep" | ./vmrun > /dev/null 2>&1 ||
+   ! echo "$deep" | ./vmrun 2>&1 | grep -q 'too complex'; then
+    echo "errors: vmrun doesn't refuse more than 8 registers"
+    failed=$((failed + 1))
+fi
+
+if [ $failed -ne 0 ]; then
+    echo "errors: $failed checks failed"
+    exit 1
+fi
+echo "errors: ok"
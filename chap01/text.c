@@ -0,0 +1,21 @@
+/* Text back end: prints the generated code as pseudo-assembly */
+
+#include <stdio.h>
+#include "lex.h"
+#include "code.h"
+
+void gen_load(char *dst, char *text, int len)
+{
+    /* The %.*s takes the maximum-number-of-characters count from len,
+     * because the lexeme isn't '\0' terminated. */
+    printf("    %s = %.*s\n", dst, len, text);
+}
+
+void gen_op(token_t op, char *dst, char *src)
+{
+    printf("    %s %c= %s\n", dst, op == PLUS ? '+' : '*', src);
+}
+
+void gen_result(char *src)
+{
+}
@@ -0,0 +1,232 @@
+/* Bytecode back end and interpreter.
+ *
+ * The gen_*() calls assemble the parser's three-address code into Program
+ * instead of printing it; vm_run() executes it against an array of
+ * variable values, one value per identifier slot. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "lex.h"
+#include "code.h"
+#include "vm.h"
+
+program_t Program;
+
+/*-----------------------------------------------------------------------------
+ * Symbol tables. Identifiers and literals are interned by their text, so each
+ * gets one var slot or constant no matter how often it's used.
+ *---------------------------------------------------------------------------*/
+typedef struct {
+    char ***names;      /* &Program.vars or a private array */
+    int *n;
+    int size;           /* slots allocated in *names */
+    int *hash;          /* open-addressed, index+1 or 0 if empty */
+    int hsize;          /* power of 2 */
+} intern_t;
+
+static char **Knames;   /* text of Program.consts[] */
+static intern_t Vartab = { &Program.vars, &Program.nvar };
+static intern_t Consttab = { &Knames, &Program.nconst };
+
+static void *xrealloc(void *p, size_t size)
+{
+    if ((p = realloc(p, size)) == NULL) {
+        fprintf(stderr, "%d: Out of memory\n", yylineno);
+        exit(1);
+    }
+    return p;
+}
+
+static unsigned hash(char *text, int len)
+{
+    unsigned h = 2166136261u;   /* FNV-1a */
+    while (--len >= 0) {
+        h = (h ^ (unsigned char) *text++) * 16777619u;
+    }
+    return h;
+}
+
+static int lookup(intern_t *tab, char *text, int len, int *bucket)
+{
+    /* Return the index of text in the table, or -1 with *bucket set to the
+     * empty slot where it belongs. */
+    unsigned h;
+    char *name;
+    int i;
+
+    if (tab->hsize == 0) {
+        return *bucket = -1;
+    }
+
+    for (h = hash(text, len);; ++h) {
+        i = tab->hash[h & (tab->hsize - 1)];
+        if (i == 0) {
+            *bucket = h & (tab->hsize - 1);
+            return -1;
+        }
+        name = (*tab->names)[i - 1];
+        if (strncmp(name, text, len) == 0 && name[len] == '\0') {
+            return i - 1;
+        }
+    }
+}
+
+static int intern(intern_t *tab, char *text, int len)
+{
+    int i, bucket;
+    char *name;
+
+    if ((i = lookup(tab, text, len, &bucket)) >= 0) {
+        return i;
+    }
+
+    if (*tab->n >= VM_MAX) {
+        fprintf(stderr, "%d: Too many distinct variables or constants\n",
+                yylineno);
+        exit(1);
+    }
+
+    if (*tab->n >= tab->size) {
+        tab->size = tab->size ? tab->size * 2 : 64;
+        *tab->names = xrealloc(*tab->names, tab->size * sizeof(char *));
+    }
+
+    if (2 * (*tab->n + 1) > tab->hsize) {
+        /* rehash at half full */
+        tab->hsize = tab->hsize ? tab->hsize * 2 : 128;
+        free(tab->hash);
+        tab->hash = xrealloc(NULL, tab->hsize * sizeof(int));
+        memset(tab->hash, 0, tab->hsize * sizeof(int));
+        for (i = 0; i < *tab->n; ++i) {
+            name = (*tab->names)[i];
+            lookup(tab, name, strlen(name), &bucket);
+            tab->hash[bucket] = i + 1;
+        }
+    }
+    lookup(tab, text, len, &bucket);
+
+    name = xrealloc(NULL, len + 1);
+    memcpy(name, text, len);
+    name[len] = '\0';
+
+    i = (*tab->n)++;
+    (*tab->names)[i] = name;
+    tab->hash[bucket] = i + 1;
+    return i;
+}
+
+int vm_slot(char *name)
+{
+    int bucket;
+    return lookup(&Vartab, name, strlen(name), &bucket);
+}
+
+/*-----------------------------------------------------------------------------
+ * The back end
+ *---------------------------------------------------------------------------*/
+static int Csize = 0;   /* instructions allocated in Program.code */
+static int Ksize = 0;   /* values allocated in Program.consts */
+
+static int regno(char *name)
+{
+    /* temporaries are named t0, t1, ...; only the first NREGS fit */
+    int n = atoi(name + 1);
+
+    if (n >= NREGS) {
+        fprintf(stderr, "%d: Expression too complex\n", yylineno);
+        exit(1);
+    }
+    return n;
+}
+
+static void emit(opcode_t op, char *dst, int src)
+{
+    insn_t *ip;
+
+    if (Program.ncode >= Csize) {
+        Csize = Csize ? Csize * 2 : 1024;
+        Program.code = xrealloc(Program.code, Csize * sizeof(insn_t));
+    }
+    ip = &Program.code[Program.ncode++];
+    ip->op = op;
+    ip->dst = dst ? regno(dst) : 0;
+    ip->src = src;
+}
+
+void gen_load(char *dst, char *text, int len)
+{
+    /* NUM_OR_ID is a constant if it starts with a digit */
+    int k;
+
+    if (!isdigit((unsigned char) *text)) {
+        emit(OP_LOADV, dst, intern(&Vartab, text, len));
+        return;
+    }
+
+    k = intern(&Consttab, text, len);
+    if (k >= Ksize) {
+        Ksize = Ksize ? Ksize * 2 : 64;
+        Program.consts = xrealloc(Program.consts, Ksize * sizeof(value_t));
+    }
+    Program.consts[k] = strtol(text, NULL, 10);
+    emit(OP_LOADK, dst, k);
+}
+
+void gen_op(token_t op, char *dst, char *src)
+{
+    emit(op == PLUS ? OP_ADD : OP_MUL, dst, regno(src));
+}
+
+void gen_result(char *src)
+{
+    emit(OP_RESULT, src, 0);
+    ++Program.nresult;
+}
+
+void vm_finish(void)
+{
+    emit(OP_HALT, NULL, 0);
+}
+
+/*-----------------------------------------------------------------------------
+ * The interpreter. With gcc, each instruction jumps straight to the next
+ * one's handler through a table of label addresses (threaded code);
+ * otherwise it's an ordinary switch in a loop.
+ *---------------------------------------------------------------------------*/
+#if defined(__GNUC__) && !defined(NO_THREADED)
+#   define THREADED
+#endif
+
+void vm_run(program_t *prog, value_t *vars, value_t *results)
+{
+    value_t r[NREGS] = { 0 };
+    value_t *k = prog->consts;
+    insn_t *ip = prog->code;
+
+#ifdef THREADED
+    static void *handler[] = {
+        &&L_OP_LOADK, &&L_OP_LOADV, &&L_OP_ADD, &&L_OP_MUL, &&L_OP_RESULT,
+        &&L_OP_HALT,
+    };
+#   define CASE(op)     L_##op
+#   define NEXT()       goto *handler[(++ip)->op]
+
+    goto *handler[ip->op];
+#else
+#   define CASE(op)     case op
+#   define NEXT()       ++ip; continue
+
+    for (;;) switch (ip->op) {
+#endif
+    CASE(OP_LOADK):     r[ip->dst] = k[ip->src];        NEXT();
+    CASE(OP_LOADV):     r[ip->dst] = vars[ip->src];     NEXT();
+    CASE(OP_ADD):       r[ip->dst] += r[ip->src];       NEXT();
+    CASE(OP_MUL):       r[ip->dst] *= r[ip->src];       NEXT();
+    CASE(OP_RESULT):    *results++ = r[ip->dst];        NEXT();
+    CASE(OP_HALT):      return;
+#ifndef THREADED
+    }
+#endif
+}
@@ -0,0 +1,43 @@
+/* vm.h -- bytecode for compiled expression statements.
+ *
+ * Every instruction is four bytes: an opcode, a destination register and a
+ * 16-bit source operand whose meaning depends on the opcode. The registers
+ * are the temporaries t0..t7 handed out by newname(); name.c makes more if
+ * an expression needs them, but the VM, the JIT and the batch evaluator
+ * have only NREGS, and the back end refuses the rest. */
+
+#define NREGS   8       /* # of registers */
+#define VM_MAX  65536   /* constants and variables addressable by src */
+
+typedef long value_t;
+
+typedef enum {
+    OP_LOADK,   /* r[dst] = Program.consts[src] */
+    OP_LOADV,   /* r[dst] = vars[src]           */
+    OP_ADD,     /* r[dst] += r[src]             */
+    OP_MUL,     /* r[dst] *= r[src]             */
+    OP_RESULT,  /* *results++ = r[dst]          */
+    OP_HALT,
+} opcode_t;
+
+typedef struct {
+    unsigned char op;
+    unsigned char dst;
+    unsigned short src;
+} insn_t;
+
+typedef struct {
+    insn_t *code;       /* instructions, ending with OP_HALT */
+    int ncode;
+    value_t *consts;    /* numeric literals                   */
+    int nconst;
+    char **vars;        /* identifiers, index is the var slot */
+    int nvar;
+    int nresult;        /* # of statements                    */
+} program_t;
+
+extern program_t Program;   /* filled in by the gen_*() calls in vm.c */
+
+void vm_finish(void);           /* append OP_HALT */
+int vm_slot(char *name);        /* var slot of an identifier or -1 */
+void vm_run(program_t *prog, value_t *vars, value_t *results);
@@ -0,0 +1,197 @@
+/* vmrun: compile the statements on standard input to bytecode and evaluate
+ * them, printing the value of each statement on its own line.
+ *
+ *      usage: vmrun [-i] [-n count] [-c columns [-o columns]]
+ *                   [name=value ...] < statements
+ *
+ * Identifiers that aren't given a value are 0. The program is compiled to
+ * native code where jit.c supports the machine, and interpreted otherwise
+ * or if -i is given. -n runs the program count times and reports the
+ * evaluation rate on stderr.
+ *
+ * Nothing is evaluated if the statements have syntax errors; vmrun exits
+ * with status 1 after the diagnostics.
+ *
+ * -c evaluates the statements once per row of a column file (see batch.h),
+ * taking each identifier from the column of the same name, or from its
+ * name=value if there's no such column. The results are printed one row per
+ * line, or written to the -o column file with one column per statement. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lex.h"
+#include "vm.h"
+#include "jit.h"
+#include "batch.h"
+
+extern void statements(void);
+extern int Nerrors;     /* in climb.c */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static value_t *column(long nrows)
+{
+    value_t *col = malloc(nrows * sizeof(value_t) + 1);
+    if (col == NULL) {
+        fprintf(stderr, "vmrun: Out of memory\n");
+        exit(1);
+    }
+    return col;
+}
+
+static int run_batch(char *in, char *out, long count, value_t *scalars)
+{
+    columns_t cols, res;
+    value_t **vars;
+    char name[16];
+    long row, n;
+    int i, slot;
+    double start, secs;
+
+    if (cols_read(in, &cols) != 0) {
+        perror(in);
+        return 1;
+    }
+
+    vars = calloc(Program.nvar + 1, sizeof(value_t *));
+    for (i = 0; i < cols.ncols; ++i) {
+        if ((slot = vm_slot(cols.names[i])) >= 0) {
+            vars[slot] = cols.data[i];
+        }
+    }
+    for (slot = 0; slot < Program.nvar; ++slot) {
+        if (vars[slot] == NULL) {
+            vars[slot] = column(cols.nrows);
+            for (row = 0; row < cols.nrows; ++row) {
+                vars[slot][row] = scalars[slot];
+            }
+        }
+    }
+
+    res.ncols = Program.nresult;
+    res.nrows = cols.nrows;
+    res.names = calloc(res.ncols + 1, sizeof(char *));
+    res.data = calloc(res.ncols + 1, sizeof(value_t *));
+    for (i = 0; i < res.ncols; ++i) {
+        sprintf(name, "%d", i + 1);
+        res.names[i] = strdup(name);
+        res.data[i] = column(res.nrows);
+    }
+
+    start = now();
+    for (n = 0; n < count; ++n) {
+        batch_run(&Program, vars, cols.nrows, res.data);
+    }
+    secs = now() - start;
+
+    if (out) {
+        if (cols_write(out, &res) != 0) {
+            perror(out);
+            return 1;
+        }
+    } else {
+        for (row = 0; row < res.nrows; ++row) {
+            for (i = 0; i < res.ncols; ++i) {
+                printf(i ? " %ld" : "%ld", res.data[i][row]);
+            }
+            printf("\n");
+        }
+    }
+
+    if (count > 1) {
+        fprintf(stderr, "batch: %ld rows x %d statements in %.3f s, "
+                "%.0f statements/s\n", count * cols.nrows, res.ncols, secs,
+                secs > 0 ? count * cols.nrows * res.ncols / secs : 0.0);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    value_t *vars, *results;
+    long count = 1, i;
+    char *eq;
+    int slot;
+    double start, secs;
+    int interpret = 0;
+    jit_fn fn = NULL;
+    char *colfile = NULL, *outfile = NULL;
+
+    statements();
+    vm_finish();
+
+    if (Nerrors) {
+        /* the program was compiled with placeholder operands, don't run it */
+        fprintf(stderr, "vmrun: %d syntax error%s\n", Nerrors,
+                Nerrors == 1 ? "" : "s");
+        return 1;
+    }
+
+    vars = calloc(Program.nvar + 1, sizeof(value_t));
+    results = calloc(Program.nresult + 1, sizeof(value_t));
+    if (vars == NULL || results == NULL) {
+        fprintf(stderr, "vmrun: Out of memory\n");
+        return 1;
+    }
+
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-i") == 0) {
+            interpret = 1;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            count = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            colfile = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outfile = argv[++i];
+        } else if ((eq = strchr(argv[i], '=')) != NULL) {
+            *eq = '\0';
+            if ((slot = vm_slot(argv[i])) < 0) {
+                fprintf(stderr, "vmrun: %s isn't used\n", argv[i]);
+            } else {
+                vars[slot] = strtol(eq + 1, NULL, 10);
+            }
+        } else {
+            fprintf(stderr, "usage: vmrun [-i] [-n count] "
+                    "[-c columns [-o columns]] [name=value ...]\n");
+            return 1;
+        }
+    }
+
+    if (colfile) {
+        return run_batch(colfile, outfile, count, vars);
+    }
+
+    if (!interpret) {
+        fn = jit_compile(&Program);
+    }
+
+    start = now();
+    for (i = 0; i < count; ++i) {
+        if (fn) {
+            (*fn)(vars, results);
+        } else {
+            vm_run(&Program, vars, results);
+        }
+    }
+    secs = now() - start;
+
+    for (i = 0; i < Program.nresult; ++i) {
+        printf("%ld\n", results[i]);
+    }
+
+    if (count > 1) {
+        fprintf(stderr, "%s: %ld statements in %.3f s, %.0f statements/s\n",
+                fn ? "native" : "interpreted", count * Program.nresult, secs,
+                secs > 0 ? count * Program.nresult / secs : 0.0);
+    }
+
+    jit_free(fn);
+    return 0;
+}
@@ -0,0 +1,365 @@
+/* ac.c -- Aho-Corasick automata for literal strings, see ac.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler.h"
+
+#include "ac.h"
+#include "memstat.h"
+
+#define NCHARS 256      /* strings are made of bytes */
+#define FREE -1         /* check of a cell no state is using */
+
+/* The trie is first built with a node per state and each node's children in
+ * a list, then laid out in the double array by ac_build(). */
+typedef struct {
+    int child;          /* first child, or -1 */
+    int sibling;        /* next child of the same parent, or -1 */
+    int c;              /* character on the edge from the parent */
+    int value;          /* value of the string ending here, or -1 */
+} TNODE;
+
+typedef struct {
+    int base;           /* the state after this one on c is base + c */
+    int check;          /* the state this one is after, or FREE */
+} CELL;
+
+struct ac {
+    TNODE *node;        /* the trie, node 0 is the root */
+    int nnodes, maxnodes;
+    int maxlen;         /* longest string */
+
+    CELL *cell;         /* the double array, indexed by state; 0 is start */
+    int ncells;
+    int *fail;          /* state for the longest proper suffix in the trie */
+    int *dict;          /* nearest state on the fail chain with a value */
+    int *value;         /* value of the string ending in a state, or -1 */
+    int *depth;         /* length of that string */
+    int nstates;
+};
+
+static void *allocate(size_t size)
+{
+    void *p = calloc(size, 1);
+
+    if (p == NULL) {
+        ferr("No memory for the literal automaton!\n");
+    }
+    mem_add(MEM_AC, size, 1);
+    return p;
+}
+
+static void release(void *p, size_t size)
+{
+    if (p) {
+        free(p);
+        mem_add(MEM_AC, -(long)size, -1);
+    }
+}
+
+static int new_node(AC *ac, int c)
+{
+    TNODE *n;
+
+    if (ac->nnodes == ac->maxnodes) {
+        ac->maxnodes = ac->maxnodes ? 2 * ac->maxnodes : 256;
+        ac->node = realloc(ac->node, ac->maxnodes * sizeof(TNODE));
+        if (ac->node == NULL) {
+            ferr("No memory for the literal automaton!\n");
+        }
+    }
+
+    n = &ac->node[ac->nnodes];
+    n->child = n->sibling = n->value = -1;
+    n->c = c;
+    return ac->nnodes++;
+}
+
+AC *ac_new(void)
+{
+    AC *ac = allocate(sizeof(AC));
+
+    new_node(ac, -1);       /* the root */
+    return ac;
+}
+
+void ac_add(AC *ac, const char *s, int len, int value)
+{
+    int n = 0, k, i;
+
+    for (i = 0; i < len; ++i) {
+        for (k = ac->node[n].child; k >= 0; k = ac->node[k].sibling) {
+            if (ac->node[k].c == (unsigned char)s[i]) {
+                break;
+            }
+        }
+        if (k < 0) {
+            k = new_node(ac, (unsigned char)s[i]);
+            ac->node[k].sibling = ac->node[n].child;
+            ac->node[n].child = k;
+        }
+        n = k;
+    }
+
+    if (ac->node[n].value < 0) {
+        ac->node[n].value = value;  /* the first one added wins */
+    }
+    if (len > ac->maxlen) {
+        ac->maxlen = len;
+    }
+}
+
+static int go(AC *ac, int s, int c)
+{
+    /* The state after s on c, or -1 */
+    int t = ac->cell[s].base + c;
+
+    return (t < ac->ncells && ac->cell[t].check == s) ? t : -1;
+}
+
+static void grow(AC *ac, int need)
+{
+    /* Make the double array at least "need" cells long */
+    int n = ac->ncells, i;
+
+    if (need <= n) {
+        return;
+    }
+    while (n < need) {
+        n = n ? 2 * n : 1024;
+    }
+
+    ac->cell = realloc(ac->cell, n * sizeof(CELL));
+    if (ac->cell == NULL) {
+        ferr("No memory for the literal automaton!\n");
+    }
+    for (i = ac->ncells; i < n; ++i) {
+        ac->cell[i].base = 0;
+        ac->cell[i].check = FREE;
+    }
+    ac->ncells = n;
+}
+
+void ac_build(AC *ac)
+{
+    /* Lay the trie out in the double array, breadth first: each state's
+     * base is the lowest that puts all of its children in free cells. Then
+     * add the failure and dictionary links, also breadth first, so a state's
+     * links are made after those of every shorter string. */
+    int *queue, *state, head, tail, n, k, s, t, f, b, first_free = 1;
+    size_t size;
+
+    queue = allocate(ac->nnodes * sizeof(int));
+    state = allocate(ac->nnodes * sizeof(int));
+    grow(ac, NCHARS + 1);
+    ac->cell[0].check = -2;     /* the start state, no state's child */
+
+    queue[0] = 0;
+    for (head = 0, tail = 1; head < tail; ++head) {
+        n = queue[head];
+        s = state[n];
+        if (ac->node[n].child < 0) {
+            continue;
+        }
+
+        while (ac->cell[first_free].check != FREE) {
+            ++first_free;
+            grow(ac, first_free + NCHARS + 1);
+        }
+        for (b = first_free > NCHARS ? first_free - NCHARS : 1;; ++b) {
+            grow(ac, b + NCHARS);
+            for (k = ac->node[n].child; k >= 0; k = ac->node[k].sibling) {
+                if (ac->cell[b + ac->node[k].c].check != FREE) {
+                    break;
+                }
+            }
+            if (k < 0) {
+                break;
+            }
+        }
+
+        ac->cell[s].base = b;
+        for (k = ac->node[n].child; k >= 0; k = ac->node[k].sibling) {
+            state[k] = b + ac->node[k].c;
+            ac->cell[state[k]].check = s;
+            queue[tail++] = k;
+        }
+    }
+
+    /* Trim the array and make the per-state tables */
+    for (n = ac->ncells; n > 1 && ac->cell[n - 1].check == FREE; --n) {
+        /* pass */
+    }
+    ac->nstates = ac->nnodes;
+    ac->ncells = n;
+    ac->cell = realloc(ac->cell, n * sizeof(CELL));
+    mem_add(MEM_AC, n * sizeof(CELL), 1);
+
+    size = n * sizeof(int);
+    ac->fail = allocate(size);
+    ac->dict = allocate(size);
+    ac->value = allocate(size);
+    ac->depth = allocate(size);
+    for (s = 0; s < n; ++s) {
+        ac->value[s] = ac->dict[s] = -1;
+    }
+
+    for (head = 0; head < tail; ++head) {
+        n = queue[head];
+        s = state[n];
+        ac->value[s] = ac->node[n].value;
+
+        for (k = ac->node[n].child; k >= 0; k = ac->node[k].sibling) {
+            t = state[k];
+            ac->depth[t] = ac->depth[s] + 1;
+
+            f = -1;
+            if (s != 0) {
+                for (f = ac->fail[s]; go(ac, f, ac->node[k].c) < 0 && f;) {
+                    f = ac->fail[f];
+                }
+                f = go(ac, f, ac->node[k].c);
+            }
+            ac->fail[t] = f < 0 ? 0 : f;
+        }
+    }
+    for (head = 1; head < tail; ++head) {
+        /* values are all in place now */
+        s = state[queue[head]];
+        f = ac->fail[s];
+        ac->dict[s] = ac->value[f] >= 0 ? f : ac->dict[f];
+    }
+
+    release(queue, ac->nnodes * sizeof(int));
+    release(state, ac->nnodes * sizeof(int));
+    free(ac->node);
+    ac->node = NULL;
+    ac->nnodes = ac->maxnodes = 0;
+}
+
+void ac_free(AC *ac)
+{
+    size_t size = ac->ncells * sizeof(int);
+
+    if (ac->cell) {
+        free(ac->cell);
+        mem_add(MEM_AC, -(long)(ac->ncells * sizeof(CELL)), -1);
+        release(ac->fail, size);
+        release(ac->dict, size);
+        release(ac->value, size);
+        release(ac->depth, size);
+    }
+    free(ac->node);
+    release(ac, sizeof(AC));
+}
+
+long ac_match(AC *ac, const unsigned char *buf, size_t len, int *valuep)
+{
+    long last = -1;
+    size_t j;
+    int s = 0;
+
+    for (j = 0; j < len && (s = go(ac, s, buf[j])) >= 0; ++j) {
+        if (ac->value[s] >= 0) {
+            last = j + 1;
+            *valuep = ac->value[s];
+        }
+    }
+    return last;
+}
+
+long ac_search(AC *ac, const unsigned char *buf, size_t len, size_t *startp,
+               int *valuep)
+{
+    /* Run the automaton until a string ends, at j. Among the strings ending
+     * there, the longest starts first; a string that starts even earlier
+     * must end after j, so it can't be longer than maxlen. Try each start
+     * between with ac_match(). */
+    size_t i, j;
+    long n;
+    int s = 0, t, m;
+
+    for (j = 0; j < len; ++j) {
+        while ((t = go(ac, s, buf[j])) < 0 && s) {
+            s = ac->fail[s];
+        }
+        s = t < 0 ? 0 : t;
+
+        if ((m = ac->value[s] >= 0 ? s : ac->dict[s]) >= 0) {
+            i = j + 1 > (size_t)ac->maxlen ? j + 1 - ac->maxlen : 0;
+            for (; i <= j + 1 - ac->depth[m]; ++i) {
+                if ((n = ac_match(ac, buf + i, len - i, valuep)) >= 0) {
+                    *startp = i;
+                    return n;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+int ac_states(AC *ac)
+{
+    return ac->nstates;
+}
+
+static void print_array(FILE *fp, char *name, int *v, int n)
+{
+    /* Print v[0..n-1] as a static array */
+    int i;
+
+    fprintf(fp, "static int %s[%d] =\n{", name, n);
+    for (i = 0; i < n; ++i) {
+        fprintf(fp, "%s%d,", i % 10 ? " " : "\n    ", v[i]);
+    }
+    fprintf(fp, "\n};\n\n");
+}
+
+void ac_print(FILE *fp, AC *ac)
+{
+    /* Write the double array as C source. Only the tables ac_match() needs
+     * go out: the scanner matches at a known position, it doesn't search. */
+    int *v, s;
+
+    fprintf(fp, "/* Literal rules, matched with an Aho-Corasick automaton */\n\n");
+    if (ac == NULL) {
+        fprintf(fp, "int yyacmatch(unsigned char *s, int len, int *valuep)\n"
+                    "{\n    return -1;\n}\n");
+        return;
+    }
+
+    v = allocate(ac->ncells * sizeof(int));
+    for (s = 0; s < ac->ncells; ++s) {
+        v[s] = ac->cell[s].base;
+    }
+    print_array(fp, "Yy_acbase", v, ac->ncells);
+    for (s = 0; s < ac->ncells; ++s) {
+        v[s] = ac->cell[s].check;
+    }
+    print_array(fp, "Yy_accheck", v, ac->ncells);
+    print_array(fp, "Yy_acvalue", ac->value, ac->ncells);
+    release(v, ac->ncells * sizeof(int));
+
+    fprintf(fp,
+        "int yyacmatch(unsigned char *s, int len, int *valuep)\n"
+        "{\n"
+        "    /* Length of the longest literal at s, its number in *valuep, or\n"
+        "     * -1 */\n"
+        "    int state = 0, t, last = -1, j;\n"
+        "\n"
+        "    for (j = 0; j < len; ++j) {\n"
+        "        t = Yy_acbase[state] + s[j];\n"
+        "        if (t >= %d || Yy_accheck[t] != state) {\n"
+        "            break;\n"
+        "        }\n"
+        "        state = t;\n"
+        "        if (Yy_acvalue[state] >= 0) {\n"
+        "            last = j + 1;\n"
+        "            *valuep = Yy_acvalue[state];\n"
+        "        }\n"
+        "    }\n"
+        "    return last;\n"
+        "}\n", ac->ncells);
+}
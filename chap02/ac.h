@@ -0,0 +1,49 @@
+/* ac.h
+ *
+ * An Aho-Corasick automaton for sets of literal strings. Each string has a
+ * value; if a string is added twice, the first value is kept, so adding the
+ * strings in rule order gives rule priority. The trie is stored as a double
+ * array, one (base, check) pair per state: the state after s on c is
+ * base[s] + c, if that state's check is s.
+ *
+ * thompson() puts the literal rules of a spec that has many of them (and
+ * whose strings aren't keywords, see keyword.h) into one of these instead of
+ * the NFA. At a given position, the lexeme is then the longer of the DFA's
+ * match (trailing context included, see dfa.h) and ac_match()'s; if they're
+ * the same length, the rule that comes first wins, and since accept strings
+ * are saved in rule order, that's the one whose accept string has the lower
+ * address.
+ *
+ * The scanner has to run both, so this is only done when Ac_literals is set
+ * (see globals.h) and the driver calls the yyacmatch() that ac_print() writes
+ * out. Its values are the literal numbers, indexes in the array from
+ * literals().
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+
+typedef struct ac AC;
+
+AC *ac_new(void);
+void ac_add(AC *ac, const char *s, int len, int value);
+void ac_build(AC *ac);      /* after the last ac_add() */
+void ac_free(AC *ac);
+
+/* Length of the longest string at the start of buf, whose value is put in
+ * *valuep, or -1 if there's none */
+long ac_match(AC *ac, const unsigned char *buf, size_t len, int *valuep);
+
+/* The leftmost longest string in buf, as ac_match(), its offset in *startp */
+long ac_search(AC *ac, const unsigned char *buf, size_t len, size_t *startp,
+               int *valuep);
+
+int ac_states(AC *ac);      /* states in the automaton */
+
+/* C source for yyacmatch(s, len, valuep), ac_match() on the tables of ac,
+ * which may be NULL (then no string matches) */
+void ac_print(FILE *fp, AC *ac);
+
+/* in nfa.c: the literal rules thompson() put in an automaton, or NULL; the
+ * values index *acceptp, an array of their accept strings */
+AC *literals(char ***acceptp);
@@ -0,0 +1,12 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+/* compiler.h -- the support routines the lexer generator is built on */
+
+/* in input_system/tools.c: print error message and exit */
+void ferr(char *format, ...);
+
+/* in tools/esc.c: the character an escape sequence stands for */
+int esc(char **s);
+
+#endif /* end of include guard: COMPILER_H */
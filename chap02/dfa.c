@@ -0,0 +1,441 @@
+/* dfa.c -- Make a DFA transition table from an NFA (subset construction),
+ * expanding the DFA states of each level on several threads. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "tools/set.h"
+#include "compiler.h"
+
+#include "nfa.h"
+#include "dfa.h"
+#include "globals.h"
+#include "memstat.h"
+
+/*-----------------------------------------------------------------------------
+ * The DFA states are built breadth first, one level at a time. The states of
+ * the current level, Lo to Hi-1, are shared out among the threads, which
+ * compute each state's move and e-closure on every character and look the
+ * resulting NFA-state set up in a hash table shared by all of them, adding
+ * it, unnumbered, if it's new. When the level is done, one thread walks its
+ * states and characters in order and numbers the new sets as it comes across
+ * them. That is the order in which the book's serial make_dtran() finds
+ * them, so the numbering is the same however many threads there are.
+ *
+ * NFA-state sets are plain bit vectors rather than SETs, which only hold
+ * characters (see tools/set.h). The NFA itself (including the
+ * character-class SETs) is only read.
+ *---------------------------------------------------------------------------*/
+typedef uint64_t word_t;
+
+#define WBITS 64
+#define MEM(s, i)   ((s)[(i) / WBITS] & ((word_t)1 << ((i) % WBITS)))
+#define INSERT(s, i) ((s)[(i) / WBITS] |= ((word_t)1 << ((i) % WBITS)))
+
+typedef struct _dstate {
+    word_t *set;            /* NFA states in this DFA state             */
+    unsigned hash;
+    int num;                /* DFA state number, -1 until it's numbered */
+    char *accept;           /* accepting string, NULL if nonaccepting   */
+    int anchor;
+    int trail;
+    struct _dstate *link;   /* next in hash chain                       */
+} DSTATE;
+
+typedef struct {
+    word_t *set;            /* scratch set for move() and e_closure()   */
+    int *stack;             /* e_closure()'s stack                      */
+} SCRATCH;
+
+#define NBUCKETS 65536      /* hash-table size, a power of 2  */
+#define NLOCKS 256          /* one lock per NBUCKETS/NLOCKS buckets */
+
+static DSTATE **Buckets;
+static pthread_mutex_t Locks[NLOCKS];
+
+static nfa_state *Nfa;      /* the NFA and its size */
+static int Nnfa;
+static int Nwords;          /* words in an NFA-state set */
+
+static DSTATE **Dstates;    /* DFA states, indexed by number */
+static ROW *Dtran;          /* transition table */
+static int Ndstates = 0;    /* # of DFA states */
+static int Dmax = 0;        /* room in Dstates and Dtran */
+
+static int Lo, Hi;          /* level being expanded */
+static DSTATE **Found;      /* Found[(s-Lo)*MAX_CHARS + c]: where s goes on c */
+static int Work;            /* next state of the level to be claimed */
+static bool Done;           /* tells the workers to quit */
+static pthread_barrier_t Level_start, Level_end;
+static pthread_mutex_t Gate = PTHREAD_MUTEX_INITIALIZER;   /* held until
+                                                the barriers are set up */
+
+/*---------------------------------------------------------------------------*/
+static void *allocate(size_t size)
+{
+    void *p = malloc(size);
+
+    if (p == NULL) {
+        ferr("No memory for DFA!\n");
+    }
+    return p;
+}
+
+static void e_closure(word_t *set, int *stack, nfa_state **accept)
+{
+    /* Add to "set" every NFA state that can be reached from it on epsilon
+     * edges. *accept is set to the lowest-numbered accepting state in the
+     * result, NULL if there's none. */
+    int *sp = stack, accept_num = Nnfa, i, w;
+    word_t bits;
+    nfa_state *p;
+
+    for (w = 0; w < Nwords; ++w) {
+        for (bits = set[w]; bits; bits &= bits - 1) {
+            *sp++ = w * WBITS + __builtin_ctzll(bits);
+        }
+    }
+
+    *accept = NULL;
+    while (sp > stack) {
+        i = *--sp;
+        p = &Nfa[i];
+
+        if (p->accept && i < accept_num) {
+            accept_num = i;
+            *accept = p;
+        }
+
+        if (p->edge == EPSILON) {
+            if (p->next && !MEM(set, p->next - Nfa)) {
+                INSERT(set, p->next - Nfa);
+                *sp++ = p->next - Nfa;
+            }
+            if (p->next2 && !MEM(set, p->next2 - Nfa)) {
+                INSERT(set, p->next2 - Nfa);
+                *sp++ = p->next2 - Nfa;
+            }
+        }
+    }
+}
+
+static bool move(word_t *from, int c, word_t *to)
+{
+    /* Put into "to" the NFA states reached from "from" on a c. Return false
+     * if there aren't any. */
+    bool found = false;
+    word_t bits;
+    nfa_state *p;
+    int w;
+
+    memset(to, 0, Nwords * sizeof(word_t));
+    for (w = 0; w < Nwords; ++w) {
+        for (bits = from[w]; bits; bits &= bits - 1) {
+            p = &Nfa[w * WBITS + __builtin_ctzll(bits)];
+            if (p->next && (p->edge == c ||
+                            (p->edge == CCL && TEST(p->bitset, c)))) {
+                INSERT(to, p->next - Nfa);
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+static DSTATE *intern(word_t *set, nfa_state *accept)
+{
+    /* Return the DFA state for "set", adding an unnumbered one if there's
+     * none. Safe to call from several threads at once. */
+    unsigned h = 2166136261u;
+    DSTATE **bucket, *d;
+    pthread_mutex_t *lock;
+    int w;
+
+    for (w = 0; w < Nwords; ++w) {
+        h = (h ^ (unsigned)set[w] ^ (unsigned)(set[w] >> 32)) * 16777619u;
+    }
+    bucket = &Buckets[h & (NBUCKETS - 1)];
+    lock = &Locks[h & (NLOCKS - 1)];
+
+    pthread_mutex_lock(lock);
+    for (d = *bucket; d; d = d->link) {
+        if (d->hash == h && !memcmp(d->set, set, Nwords * sizeof(word_t))) {
+            pthread_mutex_unlock(lock);
+            return d;
+        }
+    }
+
+    d = allocate(sizeof(DSTATE));
+    d->set = allocate(Nwords * sizeof(word_t));
+    memcpy(d->set, set, Nwords * sizeof(word_t));
+    d->hash = h;
+    d->num = -1;
+    d->accept = accept ? accept->accept : NULL;
+    d->anchor = accept ? accept->anchor : NONE;
+    d->trail = accept ? accept->trail : 0;
+    d->link = *bucket;
+    *bucket = d;
+    pthread_mutex_unlock(lock);
+
+    mem_add(MEM_DFA, sizeof(DSTATE) + Nwords * sizeof(word_t), 1);
+    return d;
+}
+
+static int number(DSTATE *d)
+{
+    /* Give d the next state number and a row in Dtran */
+    if (Ndstates >= Dmax) {
+        Dmax = Dmax ? 2 * Dmax : 256;
+        Dstates = realloc(Dstates, Dmax * sizeof(DSTATE *));
+        Dtran = realloc(Dtran, Dmax * sizeof(ROW));
+        if (Dstates == NULL || Dtran == NULL) {
+            ferr("No memory for DFA transition matrix!\n");
+        }
+    }
+
+    mem_add(MEM_DFA, sizeof(ROW), 0);
+    Dstates[Ndstates] = d;
+    return d->num = Ndstates++;
+}
+
+/*---------------------------------------------------------------------------*/
+static void expand_level(SCRATCH *w)
+{
+    /* Claim states of the current level one at a time until there are none
+     * left, and find where each of them goes on every character. */
+    DSTATE **found;
+    nfa_state *accept;
+    int s, c;
+
+    while ((s = __atomic_fetch_add(&Work, 1, __ATOMIC_RELAXED)) < Hi) {
+        found = &Found[(s - Lo) * MAX_CHARS];
+        for (c = 0; c < MAX_CHARS; ++c) {
+            if (!move(Dstates[s]->set, c, w->set)) {
+                found[c] = NULL;
+            } else {
+                e_closure(w->set, w->stack, &accept);
+                found[c] = intern(w->set, accept);
+            }
+        }
+    }
+}
+
+static void *worker(void *arg)
+{
+    /* make_dtran() sizes the barriers once it knows how many workers it
+     * got; wait for that at the gate */
+    pthread_mutex_lock(&Gate);
+    pthread_mutex_unlock(&Gate);
+
+    while (true) {
+        pthread_barrier_wait(&Level_start);
+        if (Done) {
+            break;
+        }
+        expand_level(arg);
+        pthread_barrier_wait(&Level_end);
+    }
+    return NULL;
+}
+
+static void new_scratch(SCRATCH *w)
+{
+    w->set = allocate(Nwords * sizeof(word_t));
+    w->stack = allocate(Nnfa * sizeof(int));
+}
+
+int make_dtran(nfa_state *nfa, int nstates, nfa_state **starts, int nstarts,
+               int *dstarts, ROW *(dfap[]), ACCEPT *(*acceptp))
+{
+    /* Make the transition table for the NFA of "nstates" states in the
+     * array "nfa", which has the "nstarts" start states in "starts". *dfap
+     * is set to the table and *acceptp to an array of the accepting strings,
+     * both indexed by DFA state number. The DFA state for starts[i] is put
+     * in dstarts[i]; they're numbered first, in order, so starts[0] is
+     * state 0. Return the number of DFA states. */
+    int nthreads = Threads > 1 ? Threads : 1, running, i, s, c;
+    pthread_t *threads;
+    SCRATCH *scratch;
+    ACCEPT *accepts;
+    nfa_state *accept;
+    DSTATE *d, *link;
+
+    Nfa = nfa;
+    Nnfa = nstates;
+    Nwords = (nstates + WBITS - 1) / WBITS;
+    Ndstates = 0;
+    Buckets = calloc(NBUCKETS, sizeof(DSTATE *));
+    threads = allocate(nthreads * sizeof(pthread_t));
+    scratch = allocate(nthreads * sizeof(SCRATCH));
+    if (Buckets == NULL) {
+        ferr("No memory for DFA!\n");
+    }
+
+    for (i = 0; i < NLOCKS; ++i) {
+        pthread_mutex_init(&Locks[i], NULL);
+    }
+    for (i = 0; i < nthreads; ++i) {
+        new_scratch(&scratch[i]);
+    }
+
+    /* The start states are the e-closures of the NFA's; they're the first
+     * level */
+    for (i = 0; i < nstarts; ++i) {
+        memset(scratch[0].set, 0, Nwords * sizeof(word_t));
+        INSERT(scratch[0].set, starts[i] - nfa);
+        e_closure(scratch[0].set, scratch[0].stack, &accept);
+        d = intern(scratch[0].set, accept);
+        dstarts[i] = d->num >= 0 ? d->num : number(d);
+    }
+
+    /* Thread 0 is this one. If a worker can't be started, carry on with
+     * the ones that were. */
+    Done = false;
+    pthread_mutex_lock(&Gate);
+    for (running = 1; running < nthreads; ++running) {
+        if (pthread_create(&threads[running], NULL, worker,
+                           &scratch[running]) != 0) {
+            break;
+        }
+    }
+    if (running > 1) {
+        pthread_barrier_init(&Level_start, NULL, running);
+        pthread_barrier_init(&Level_end, NULL, running);
+    }
+    pthread_mutex_unlock(&Gate);
+
+    for (Lo = 0, Hi = Ndstates; Lo < Hi; Lo = Hi, Hi = Ndstates) {
+        Found = allocate((Hi - Lo) * MAX_CHARS * sizeof(DSTATE *));
+        Work = Lo;
+
+        if (running > 1) {
+            pthread_barrier_wait(&Level_start);
+            expand_level(&scratch[0]);
+            pthread_barrier_wait(&Level_end);
+        } else {
+            expand_level(&scratch[0]);
+        }
+
+        /* Number the new states in order of discovery */
+        for (s = Lo; s < Hi; ++s) {
+            for (c = 0; c < MAX_CHARS; ++c) {
+                d = Found[(s - Lo) * MAX_CHARS + c];
+                Dtran[s][c] = !d ? F : d->num >= 0 ? d->num : number(d);
+            }
+        }
+        free(Found);
+    }
+
+    if (running > 1) {
+        Done = true;
+        pthread_barrier_wait(&Level_start);
+        for (i = 1; i < running; ++i) {
+            pthread_join(threads[i], NULL);
+        }
+        pthread_barrier_destroy(&Level_start);
+        pthread_barrier_destroy(&Level_end);
+    }
+
+    /* Hand over the table and accepting strings, discard the sets */
+    accepts = allocate((Ndstates + 1) * sizeof(ACCEPT));
+    for (s = 0; s < Ndstates; ++s) {
+        accepts[s].string = Dstates[s]->accept;
+        accepts[s].anchor = Dstates[s]->anchor;
+        accepts[s].trail = Dstates[s]->trail;
+    }
+
+    for (i = 0; i < NBUCKETS; ++i) {
+        for (d = Buckets[i]; d; d = link) {
+            link = d->link;
+            free(d->set);
+            free(d);
+            mem_add(MEM_DFA, -(long)(sizeof(DSTATE) +
+                                     Nwords * sizeof(word_t)), -1);
+        }
+    }
+    for (i = 0; i < nthreads; ++i) {
+        free(scratch[i].set);
+        free(scratch[i].stack);
+    }
+    free(scratch);
+    free(threads);
+    free(Buckets);
+    free(Dstates);
+    Dstates = NULL;
+    Dmax = 0;
+
+    *dfap = Dtran;
+    *acceptp = accepts;
+    Dtran = NULL;
+    return Ndstates;
+}
+
+static int *Dstarts;     /* DFA start states, made by dfa() */
+static int Ndstarts;
+
+int dfa_starts(int **tabp)
+{
+    /* The DFA's start states, indexed like start_states()'s */
+    *tabp = Dstarts;
+    return Ndstarts;
+}
+
+int dfa(char *(*ifunct)(), ROW *(dfap[]), ACCEPT *(*acceptp))
+{
+    /* Turn the NFA read by ifunct() into a DFA and return the number of
+     * states in the DFA transition table. *dfap is modified to point at that
+     * transition table and *acceptp is modified to point at an array of
+     * accepting states (indexed by state number). dfa_starts() has the
+     * start states. */
+    nfa_state *nfa, *start, **starts;
+    int nstates, ndfa;
+
+    nfa = thompson(ifunct, &nstates, &start);
+    Ndstarts = start_states(&starts);
+    if ((Dstarts = realloc(Dstarts, Ndstarts * sizeof(int))) == NULL) {
+        ferr("No memory for DFA!\n");
+    }
+    ndfa = make_dtran(nfa, nstates, starts, Ndstarts, Dstarts, dfap,
+                      acceptp);
+
+    if (Verbose) {
+        printf("%d DFA states in initial machine (%d thread%s).\n", ndfa,
+               Threads > 1 ? Threads : 1, Threads > 1 ? "s" : "");
+        printf("%d bytes required for uncompressed tables.\n\n",
+               ndfa * (int)sizeof(ROW) + ndfa * (int)sizeof(ACCEPT));
+    }
+
+    return ndfa;
+}
+
+void print_starts(FILE *fp)
+{
+    /* Write the start conditions and start states as C source. yystart(bol)
+     * is the state a lexeme starts in, bol being 1 if the character before
+     * it was a newline (or there wasn't one, see ii_bol()). "BEGIN NAME;"
+     * changes the start condition, which only moves Yy_cstart. */
+    char **names;
+    int i, n = conditions(&names);
+
+    fprintf(fp, "/* Start conditions and their start states */\n\n");
+    for (i = 0; i < n; ++i) {
+        fprintf(fp, "#define %s %d\n", names[i], i);
+    }
+
+    fprintf(fp, "\nstatic int Yy_start[%d] =\n{", Ndstarts);
+    for (i = 0; i < Ndstarts; ++i) {
+        fprintf(fp, "%s%d,", i % 10 ? " " : "\n    ", Dstarts[i]);
+    }
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp,
+        "static int *Yy_cstart = Yy_start;  /* the current condition's */\n"
+        "\n"
+        "#define BEGIN           Yy_cstart = Yy_start + 2 *\n"
+        "#define YY_START        ((int)(Yy_cstart - Yy_start) / 2)\n"
+        "#define yystart(bol)    Yy_cstart[bol]\n");
+}
@@ -0,0 +1,37 @@
+/* dfa.h
+ *
+ * Subset construction: make a DFA transition table from the NFA built by
+ * thompson(). The frontier of unexpanded DFA states is expanded by Threads
+ * worker threads at once (see globals.h); the states are still numbered in
+ * the order a serial construction would discover them, so the table doesn't
+ * depend on how the threads were scheduled.
+ *
+ * Each start condition has two start states, chosen by the character before
+ * the lexeme: one after a newline (or at the start of the input), where the
+ * ^ rules are active too, and one for anywhere else. So ^ needs no newline
+ * in front of the input and no extra test in the scanning loop.
+ *
+ * A rule with trailing context (r/s or r$) matches its context too, and the
+ * longest match counts it. Once the action is chosen, the lexeme's end is
+ * found from the accepting state's trail without rescanning: after
+ * ii_to_mark(), ii_pusback(trail) if trail >= 0, else
+ * ii_pusback(ii_length() + trail).
+ */
+
+#define MAX_CHARS 256   /* Maximum width of DFA transition table, a byte */
+#define F -1            /* Marks failure transitions in the table */
+
+typedef int ROW[MAX_CHARS];     /* One row of the transition table */
+
+typedef struct accept {
+    char *string;   /* Accepting string; NULL if nonaccepting */
+    int anchor;     /* Anchor point, if any. Values are defined in nfa.h */
+    int trail;      /* Trailing context, as in nfa_state */
+} ACCEPT;
+
+/* in dfa.c */
+int dfa(char *(*ifunct)(), ROW *(dfap[]), ACCEPT *(*acceptp));
+int make_dtran(nfa_state *nfa, int nstates, nfa_state **starts, int nstarts,
+               int *dstarts, ROW *(dfap[]), ACCEPT *(*acceptp));
+int dfa_starts(int **tabp);     /* start states, by condition * 2 + bol */
+void print_starts(FILE *fp);    /* C source for them and BEGIN */
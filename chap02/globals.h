@@ -10,12 +10,19 @@
     #define I(x)
 #endif
 
-#define MAXINP = 2048;    /* Maximum rule size */
+#define MAXINP 2048    /* Maximum rule size */
 
 CLASS int Verbose I( = 0 ); /* Print statistics */
 CLASS int No_lines I( = 0); /* Supress #line directive. */
+CLASS int Hash_keywords I( = 0); /* Take keyword rules out of the NFA, see
+                                    keyword.h */
+CLASS int Ac_literals I( = 0); /* Take literal rules out of the NFA, see
+                                  ac.h */
 CLASS int Unix  I( = 0 ); /* Use UNIX-style newlines */
+CLASS int Utf8  I( = 0 ); /* Rules are UTF-8, classes sets of code points */
 CLASS int Public I( = 0); /* make static symbols public */
+CLASS int Threads I( = 1); /* Threads used by thompson() and the subset
+                               construction */
 CLASS char *Templage I( = "lex.par"); /* State-machine driver template */
 CLASS int Actual_lineno I( = 1); /* Current input line number */
 CLASS int Lineno I( = 1 );      /* Line number of first line of a
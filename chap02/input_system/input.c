@@ -7,7 +7,11 @@
 #include <unistd.h> /* for close() */
 #include <string.h>
 #include <stdbool.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "tools.h"
+#include "input.h"
 
 /*---------------------------------------------------------------------------
  * Helper functions */
@@ -15,26 +19,55 @@
 
 /*---------------------------------------------------------------------------*/
 #define STDIN 0         /* file descriptor of standard input */
-#define MAXLOOK 16      /* maximum amount of lookahead       */
-#define MAXLEN 1024     /* maximum lexeme sizes              */
-#define BUFSIZE ((3 * MAXLEN) + (2 * MAXLOOK)) /* change *3* only */
-#define DANGER (End_buf - MAXLOOK)  /* flush buffer when Next passes this
+#define RA_CHUNK (64 * 1024)    /* read-ahead unit, see ii_readahead() */
+#define MAXLOOK 16      /* default lookahead kept before a flush */
+#define MAXLEN 1024     /* default read size                   */
+#define BUFSIZE ((3 * MAXLEN) + (2 * MAXLOOK)) /* default buffer size */
+#define DANGER (End_buf - Maxlook)  /* flush buffer when Next passes this
                                        addresses */
-#define END (&Start_buf[BUFSIZE])   /* Just past last char in buf */
+#define END (&Start_buf[Bufsize])   /* Just past last char in buf */
 #define NO_MORE_CHARS() (Eof_read && Next >= End_buf)
 
-static unsigned char Start_buf[BUFSIZE];   /* input bffer */
-static unsigned char *End_buf = END;       /* just past last character */
-static unsigned char *Next = END;          /* next input character */
-static unsigned char *sMark = END;         /* start of current lexeme */
-static unsigned char *eMark = END;         /* end of current lexeme */
+/* The buffer geometry, set by ii_config(). The buffer starts out as
+ * Default_buf and is replaced by a malloc()ed one when it's resized. Either
+ * way it has a spare byte after END for the sentinel. Start_buf and Bufsize
+ * describe the caller's memory instead after ii_newbuffer(); Ibuf and
+ * Ibufsize always describe ours. */
+static unsigned char Default_buf[BUFSIZE + 1];
+static unsigned char *Ibuf = Default_buf;
+static size_t Ibufsize = BUFSIZE;
+static size_t Bufsize = BUFSIZE;           /* size of the input buffer */
+static size_t Readsize = MAXLEN;           /* read() request unit */
+static int Maxlook = MAXLOOK;              /* lookahead kept before a flush */
+static size_t Maxlex = 0;                  /* longest lexeme, 0 if no limit */
+
+static unsigned char *Start_buf = Default_buf;        /* input bffer */
+static unsigned char *End_buf = &Default_buf[BUFSIZE];/* just past last char */
+static unsigned char *Next = &Default_buf[BUFSIZE];   /* next input char */
+static unsigned char *sMark = &Default_buf[BUFSIZE];  /* start of lexeme */
+static unsigned char *eMark = &Default_buf[BUFSIZE];  /* end of lexeme */
 static unsigned char *pMark = NULL;        /* start of previous lexeme */
-static int pLineno = 0;                    /* Line # of previous lexeme */
+
+/* ii_advance() only checks for the end of the usable input when it reads a
+ * '\0'. A '\0' is stored at Sentinel, which is DANGER (or End_buf at end of
+ * file), and the character it replaces is kept in Saved. Sentinel is NULL
+ * while the buffer is being flushed or filled. */
+static unsigned char *Sentinel = &Default_buf[BUFSIZE];
+static unsigned char Saved = 0;
+
 static int pLength = 0;                    /* length of previous lexeme */
 
-static int Input_file = STDIN;             /* input file handle */
-static int Lineno = 1;                     /* current line number */
-static int Mline = 1;                      /* Line # when mark_end() called */
+/* Line numbers aren't kept up to date as characters are read. The line
+ * number is known at one place in the buffer, Line_pos, and ii_lineno()
+ * works out the one at Next by counting the newlines in between. */
+static unsigned char *Line_pos = &Default_buf[BUFSIZE];
+static int Line_base = 1;                  /* line number at Line_pos */
+static unsigned char *pLine = NULL;        /* Next when pMark was set */
+
+static int Input_file = STDIN;             /* input file handle, -1 if the
+                                              input isn't a file */
+static ii_source_t Source;                 /* or the source, see
+                                              ii_newsource() */
 static int Termchar = 0;                   /* Holds the character that was
                                               overwritten by a '\0' when we
                                               null terminated the last lexeme.
@@ -44,14 +77,154 @@ static bool Eof_read = false;              /* End of file has been read.  It's
                                               for characters to still be in
                                               the input buffer . */
 
+static bool Readahead = false;             /* read ahead in new files */
+static bool Reading_ahead = false;         /* ...and in this one */
+static off_t Offset = 0;                   /* file offset of End_buf */
+static off_t Ahead = 0;                    /* read-ahead asked for up to here */
+static int Before = '\n';                  /* the character before
+                                              Start_buf[0], '\n' at the start
+                                              of the input; see ii_bol() */
+static bool Started = false;               /* the buffer has had input in it */
+
+extern int Verbose;                        /* in globals.h */
+static ii_stats_t Stats;                   /* see ii_stats() */
+
 /*---------------------------------------------------------------------------
  * Function prototype */
-int ii_flush(bool force);
-int ii_fillbuf(unsigned char *starting_at);
+static int flush(bool force);
+static int refill(bool force);
+static int fillbuf(unsigned char *starting_at);
+
+/*---------------------------------------------------------------------------
+ * Statistics */
+const ii_stats_t *ii_stats(void)
+{
+    return &Stats;
+}
+
+void ii_print_stats(FILE *fp)
+{
+    fprintf(fp, "input system:\n");
+    fprintf(fp, "    %ld reads, %ld bytes\n", Stats.fills, Stats.bytes_read);
+    fprintf(fp, "    %ld flushes, %ld bytes moved, %ld forced\n",
+            Stats.flushes, Stats.bytes_moved, Stats.forced);
+    fprintf(fp, "    longest lexeme %ld bytes, buffer grown %ld times\n",
+            Stats.max_lexeme, Stats.grows);
+    fprintf(fp, "    %ld characters pushed back, at most %ld at once\n",
+            Stats.pushbacks, Stats.max_pushback);
+}
+
+static void print_stats_at_exit(void)
+{
+    ii_print_stats(stderr);
+}
 
 /*---------------------------------------------------------------------------
  * Initialization routines. */
 
+static void clear_sentinel(void);
+static void set_sentinel(void);
+static void new_input(void);
+
+int ii_config(const ii_config_t *cfg)
+{
+    /* Set the buffer geometry. A zero field keeps the default: reads of
+     * MAXLEN bytes, MAXLOOK characters of lookahead, no limit on lexeme size
+     * and a buffer big enough for three reads plus the lookahead on either
+     * side, as in the book. The buffer must hold at least two reads. The
+     * buffer is emptied, so call this before ii_newfile(). Return -1 (and
+     * change nothing) if the geometry is unusable or there's no memory.
+     */
+    size_t readsize = cfg->readsize ? cfg->readsize : MAXLEN;
+    int maxlook = cfg->maxlook ? cfg->maxlook : MAXLOOK;
+    size_t bufsize = cfg->bufsize ? cfg->bufsize : 3 * readsize + 2 * maxlook;
+    unsigned char *buf;
+
+    if (maxlook < 0 || bufsize < 2 * readsize + 2 * maxlook) {
+        return -1;
+    }
+
+    if (bufsize == BUFSIZE) {
+        buf = Default_buf;
+    } else if ((buf = malloc(bufsize + 1)) == NULL) {
+        return -1;
+    }
+
+    clear_sentinel();
+    if (Ibuf != Default_buf) {
+        free(Ibuf);
+    }
+
+    Ibuf = Start_buf = buf;
+    Ibufsize = Bufsize = bufsize;
+    Readsize = readsize;
+    Maxlook = maxlook;
+    Maxlex = cfg->maxlex;
+
+    Next = sMark = eMark = End_buf = Sentinel = Line_pos = END;
+    *Sentinel = Saved = '\0';
+    pMark = pLine = NULL;
+    Line_base = 1;
+    Before = '\n';
+    Started = false;
+    return 0;
+}
+
+static int grow(void)
+{
+    /* Double the size of the buffer so that it can hold a lexeme that doesn't
+     * fit, moving every pointer into it along with the text. Return 0 if the
+     * lexeme has reached the Maxlex limit or there's no memory. */
+    size_t next = Next - Start_buf, smark = sMark - Start_buf,
+           emark = eMark - Start_buf, end = End_buf - Start_buf,
+           pmark = pMark ? pMark - Start_buf : 0,
+           line_pos = Line_pos - Start_buf,
+           pline = pLine ? pLine - Start_buf : 0;
+    unsigned char *buf;
+
+    if (Maxlex && next - smark >= Maxlex) {
+        return 0;
+    }
+
+    if (Start_buf == Default_buf) {
+        if ((buf = malloc(2 * Bufsize + 1)) != NULL) {
+            memcpy(buf, Default_buf, Bufsize);
+        }
+    } else {
+        buf = realloc(Start_buf, 2 * Bufsize + 1);
+    }
+
+    if (buf == NULL) {
+        return 0;
+    }
+
+    Ibuf = Start_buf = buf;
+    Ibufsize = Bufsize *= 2;
+    Next = buf + next;
+    sMark = buf + smark;
+    eMark = buf + emark;
+    End_buf = buf + end;
+    Line_pos = buf + line_pos;
+    if (pMark) {
+        pMark = buf + pmark;
+        pLine = buf + pline;
+    }
+
+    ++Stats.grows;
+    return 1;
+}
+
+void ii_readahead(bool on)
+{
+    /* Have the kernel read ahead in files opened from now on: fillbuf()
+     * keeps a window of RA_CHUNK to 2 * RA_CHUNK bytes past the last read
+     * asked for with POSIX_FADV_WILLNEED, so the next read() finds its pages
+     * in memory while the lexer is still scanning. read() puts the data
+     * straight into the input buffer as always. Ignored for pipes and the
+     * like, which posix_fadvise() refuses. */
+    Readahead = on;
+}
+
 int ii_newfile(char *filename)
 {
     /* prepare a new input file for reading. If newfile() isn't called before
@@ -67,40 +240,152 @@ int ii_newfile(char *filename)
      */
 
     int fd;     /* file descriptor */
+
     fd = (filename == NULL) ? STDIN : open(filename, O_RDONLY);
     if (fd != -1) {
-        /* close the current input file and re-initialize variables */
-        if (Input_file != STDIN) {
-            close(Input_file);
-        }
-
+        new_input();
         Input_file = fd;
-        Eof_read = false;
-
-        Next = END;
-        sMark = END;
-        eMark = END;
-        End_buf = END;
-        Lineno = 1;
-        Mline = 1;
+        Reading_ahead = Readahead &&
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL) == 0;
     }
 
     return fd;
 }
 
+int ii_newsource(const ii_source_t *src)
+{
+    /* Take input from src, which fills our buffer directly, instead of from
+     * a file. The current input is closed. Always returns 0. */
+    new_input();
+    Input_file = -1;
+    Source = *src;
+    return 0;
+}
+
+int ii_newbuffer(void *buf, size_t len)
+{
+    /* Scan the len characters at buf where they are, without copying them.
+     * The buffer must be writable and have one spare byte after the last
+     * character: the sentinel goes there, and ii_term() and ii_uninput()
+     * write into the text. Nothing more is
+     * read, and the buffer is left as it was when the input is closed by
+     * the next ii_new*() call. Always returns 0. */
+    new_input();
+    Input_file = -1;
+
+    Start_buf = buf;
+    Bufsize = len;
+    Next = sMark = eMark = Line_pos = Start_buf;
+    End_buf = END;
+    Eof_read = true;
+    Started = true;
+    set_sentinel();
+    return 0;
+}
+
+static void new_input(void)
+{
+    /* close the current input and re-initialize variables for a new one
+     * that's read into our own buffer */
+    static bool stats_registered = false;
+
+    if (Verbose && !stats_registered) {
+        atexit(print_stats_at_exit);
+        stats_registered = true;
+    }
+
+    clear_sentinel();
+    Reading_ahead = false;
+    Offset = Ahead = 0;
+    if (Source.close) {
+        Source.close(Source.arg);
+    }
+    memset(&Source, 0, sizeof(Source));
+    if (Input_file > STDIN) {
+        close(Input_file);
+    }
+
+    Start_buf = Ibuf;
+    Bufsize = Ibufsize;
+    Eof_read = false;
+
+    Next = END;
+    sMark = END;
+    eMark = END;
+    End_buf = END;
+    Sentinel = END;
+    *Sentinel = Saved = '\0';
+    Line_pos = END;
+    Line_base = 1;
+    pMark = pLine = NULL;
+    Before = '\n';
+    Started = false;
+}
+
+/*---------------------------------------------------------------------------
+ * Line numbers */
+static int count_newlines(unsigned char *p, unsigned char *end)
+{
+    /* Count the newlines in [p, end). The sentinel hides a character, which
+     * is counted if it's a newline. */
+    int n = (Sentinel >= p && Sentinel < end && Saved == '\n');
+
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8('\n');
+
+    for (; end - p >= 16; p += 16) {
+        n += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(
+                    _mm_loadu_si128((const __m128i *)p), nl)));
+    }
+#endif
+
+    for (; p < end; ++p) {
+        n += (*p == '\n');
+    }
+
+    return n;
+}
+
+static int sync_line(unsigned char *p)
+{
+    /* Move Line_pos to p and return the line number there */
+    if (p >= Line_pos) {
+        Line_base += count_newlines(Line_pos, p);
+    } else {
+        Line_base -= count_newlines(p, Line_pos);
+    }
+
+    Line_pos = p;
+    return Line_base;
+}
+
+static void before_store(void)
+{
+    /* Call before overwriting *Next; Line_pos mustn't be past it then */
+    if (Line_pos > Next) {
+        sync_line(Next);
+    }
+}
+
 /*---------------------------------------------------------------------------
  * access routines and marker movement */
 char *ii_text(void)  { return (sMark); }
 int ii_length(void)  { return (eMark - sMark); }
-int ii_lineno(void)  { return (Lineno); }
+int ii_lineno(void)  { return sync_line(Next); }
 char *ii_ptext(void) { return (pMark); }
 int ii_plength(void) { return (pLength); }
-int ii_plineno(void) { return (pLineno); }
+int ii_plineno(void) { return pLine ? sync_line(pLine) : 0; }
+
+/* true if the lexeme starts a line: it's at the start of the input or after
+ * a newline. A LeX scanner picks its start state with this (see dfa.h). */
+int ii_bol(void)
+{
+    return (Started && sMark > Start_buf ? sMark[-1] : Before) == '\n';
+}
 
 /* move sMark to the current input position(Next) */
 char *ii_mark_start()
 {
-    Mline = Lineno;
     eMark = sMark = Next;
     return sMark;
 }
@@ -109,8 +394,10 @@ char *ii_mark_start()
 /* move eMark to the current input position(Next) */
 char *ii_mark_end()
 {
-    Mline = Lineno;
     eMark = Next;
+    if (eMark - sMark > Stats.max_lexeme) {
+        Stats.max_lexeme = eMark - sMark;
+    }
     return eMark;
 }
 
@@ -127,7 +414,6 @@ char *ii_move_start()
 /* restores the input pointer to the last end mark. */
 char *ii_to_mark()
 {
-    Lineno = Mline;
     Next = eMark;
     return Next;
 }
@@ -143,48 +429,82 @@ char *ii_mark_prev()
      * ii_mark_prev() is never called, pMark is just ignored and you don't
      * have to worry about it */
     pMark = sMark;
-    pLineno = Lineno;
+    pLine = Next;
     pLength = eMark - sMark;
     return pMark;
 }
 
+/*---------------------------------------------------------------------------
+ * The sentinel */
+static void clear_sentinel(void)
+{
+    if (Sentinel) {
+        *Sentinel = Saved;
+        Sentinel = NULL;
+    }
+}
+
+static void set_sentinel(void)
+{
+    /* Put the sentinel where the next flush is due, or at end of input once
+     * nothing more can be read. It's never put behind Next. */
+    Sentinel = Eof_read ? End_buf : DANGER;
+    if (Sentinel < Next) {
+        Sentinel = Next;
+    }
+    Saved = *Sentinel;
+    *Sentinel = '\0';
+}
+
 /*---------------------------------------------------------------------------
  * The advance function */
+static int advance_slow(void);
+
 int ii_advance()
 {
     /* ii_advance() is the real input function. It returns the next character
      * from input and advances past it. The buffer is flushed if the current
-     * character is within MAXLOOK characters of the end of the buffer. 0 is
-     * returned at end of file. -1 is returned if the buffer can't be flushed.
-     * because it's too full. In this case you can call ii_flush(1) to do a
-     * buffer flush but you'll loose the current lexeme as a consequence.
+     * character is within Maxlook characters of the end of the buffer. 0 is
+     * returned at end of file. -1 is returned if the buffer can't be flushed
+     * because the current lexeme has reached the Maxlex limit (or the buffer
+     * can't grow). In this case you can call ii_flush(1) to do a buffer
+     * flush but you'll loose the current lexeme as a consequence.
+     *
+     * Only a '\0' needs a closer look: it's either the sentinel or a '\0' in
+     * the input.
      */
-    static int been_called = 0;
-    if (!been_called) {
-        /* push a newline into the empty buffer so that the LeX start-of-line
-         * anchor will work on the first input line 
-         * Note: a NEWLINE will be appended in front of the first line of *
-         * the file.*/
-        Next = sMark = eMark = END-1;
-        *Next = '\n';
-        --Lineno;
-        --Mline;
-        been_called = 1;
+    int c = *Next;
+
+    if (c) {
+        ++Next;
+        return c;
     }
 
-    if (NO_MORE_CHARS()) {
+    return advance_slow();
+}
+
+static int advance_slow(void)
+{
+    int c;
+
+    if (Next != Sentinel) {     /* a '\0' in the input */
+        ++Next;
         return 0;
     }
 
-    if (!Eof_read && ii_flush(0) < 0) {
-        return -1;
-    }
+    clear_sentinel();
 
-    if (*Next == '\n') {
-        Lineno ++;
+    /* The flush may be what finds the end of file, with nothing read */
+    if (!NO_MORE_CHARS() && !Eof_read && flush(0) < 0) {
+        c = -1;
+    } else if (NO_MORE_CHARS()) {
+        c = 0;
+    } else {
+        c = *Next++;
     }
 
-    return (*Next++);
+    set_sentinel();
+    return c;
 }
 
 int ii_flush(bool force)
@@ -198,15 +518,23 @@ int ii_flush(bool force)
      *
      * Either the pMark or sMark(which is smaller) is used as the leftmost
      * edge of the buffer. None of the text to the right of the mark will be
-     * lost. Return 1 if everything's ok, -1 if the buffer is so full that it
-     * can't be flushed. 0 if we're at end of file. If "force" is true, a
+     * lost; if keeping it leaves no room for a read, the buffer is grown.
+     * Return 1 if everything's ok, -1 if the buffer is so full that it can't
+     * be flushed and can't grow. 0 if we're at end of file. If "force" is true, a
      * buffer flush is forced and the characters already in it are discarded.
      * Don't call this function on a buffer that's been terminated by
      * ii_term().
      */
-    int copy_amount, shift_amount;
-    unsigned char *left_edge;
-    
+    int ret;
+
+    clear_sentinel();
+    ret = flush(force);
+    set_sentinel();
+    return ret;
+}
+
+static int flush(bool force)
+{
     if (NO_MORE_CHARS()) {
         return 0;
     }
@@ -216,69 +544,129 @@ int ii_flush(bool force)
     }
     
     if (Next >= DANGER || force) {
+        return refill(force);
+    }
+
+    return 1;
+}
+
+static int refill(bool force)
+{
+    /* The work of a flush, wherever Next is: move everything from the left
+     * edge on to the start of the buffer (growing it if that doesn't leave
+     * room for a read) and read more after it. Return 1, or -1 if there's no
+     * room and force is false. */
+    size_t copy_amount, shift_amount;
+    unsigned char *left_edge;
+
+    left_edge = pMark ? min(sMark, pMark) : sMark;
+    shift_amount = left_edge - Start_buf;
+
+    if (shift_amount < Readsize && END - End_buf < Readsize && !force
+            && grow()) {
+        /* not enough room for a read, but there is now */
         left_edge = pMark ? min(sMark, pMark) : sMark;
         shift_amount = left_edge - Start_buf;
+    }
 
-        if (shift_amount < MAXLEN) {
-            /* if not enough room (should be available for at least one
-             * lexeme). */
-            if (force == false) {
-                return -1;
-            }
-
-            /* ignoring all saved lexemes */
-            left_edge = ii_mark_start();
-            ii_mark_prev();
-            shift_amount = left_edge - Start_buf;
+    if (shift_amount < Readsize && END - End_buf < Readsize) {
+        /* if not enough room (should be available for at least one
+         * read). A short read leaves room after End_buf, in which
+         * case there's no need to shift. */
+        if (force == false) {
+            return -1;
         }
 
-        copy_amount = End_buf - left_edge;
-        memcpy(Start_buf, left_edge, copy_amount);
+        /* ignoring all saved lexemes */
+        ++Stats.forced;
+        left_edge = ii_mark_start();
+        ii_mark_prev();
+        shift_amount = left_edge - Start_buf;
+    }
 
-        if (!ii_fillbuf(Start_buf + copy_amount)) {
-            ferr("INTERNAL ERROR, ii_flush: Buffer full, can't read.\n");
-        }
+    if (Line_pos < left_edge) {     /* its text is about to go */
+        sync_line(left_edge);
+    }
+    if (Started && left_edge > Start_buf) {
+        Before = left_edge[-1];
+    }
 
-        if (pMark) {
-            pMark -= shift_amount;
-        }
+    copy_amount = End_buf - left_edge;
+    memmove(Start_buf, left_edge, copy_amount);
+    ++Stats.flushes;
+    Stats.bytes_moved += copy_amount;
+
+    if (!fillbuf(Start_buf + copy_amount) && !Eof_read) {
+        ferr("INTERNAL ERROR, ii_flush: Buffer full, can't read.\n");
+    }
+    Started = true;
 
-        sMark -= shift_amount;
-        eMark -= shift_amount;
-        Next -= shift_amount;
+    if (pMark) {
+        pMark -= shift_amount;
+        pLine -= shift_amount;
     }
 
+    Line_pos -= shift_amount;
+    sMark -= shift_amount;
+    eMark -= shift_amount;
+    Next -= shift_amount;
+
     return 1;
 }
 
 /*---------------------------------------------------------------------------*/
 int ii_fillbuf(unsigned char *starting_at)
+{
+    int got;
+
+    clear_sentinel();
+    got = fillbuf(starting_at);
+    set_sentinel();
+    return got;
+}
+
+static int fillbuf(unsigned char *starting_at)
 {
     /* Fill the input buffer from starting_at to the end of the buffer. The
      * input file is not closed when EOF is reached. Buffers are read in units
-     * of MAXLEN characters; It's an error if that many characters cannot be
-     * read (0 is returned in this case). For example, if MAXLEN is 1024, then
-     * 1024 characters will be read at a time. The number of characters read
-     * is returned. Eof_read is true as soon as the last buffer is read. */
+     * of Readsize characters; It's an error if that many characters cannot be
+     * read (0 is returned in this case). For example, if Readsize is 1024,
+     * then 1024 characters will be read at a time. The number of characters
+     * read is returned. Eof_read is true as soon as the last buffer is read.
+     */
     size_t need;    /* number of bytes required from input */
     size_t got;     /* number of bytes actually read. */
 
-    need = ((END-starting_at) / MAXLEN) * MAXLEN;
-
-    if (need < 0) {
+    if (starting_at > END) {
         ferr("INTERNAL ERROR (ii_fillbuf): Bad read-request starting addr.\n");
     }
 
+    need = ((END-starting_at) / Readsize) * Readsize;
+
     if (need == 0) {
         return 0;
     }
 
-    got = read(Input_file, starting_at, need);
+    if (Source.read) {
+        got = Source.read(Source.arg, starting_at, need);
+    } else {
+        if (Reading_ahead && Offset + (off_t)need + RA_CHUNK > Ahead) {
+            Ahead = Offset + (off_t)need + 2 * RA_CHUNK;
+            posix_fadvise(Input_file, Offset, Ahead - Offset,
+                          POSIX_FADV_WILLNEED);
+        }
+        got = read(Input_file, starting_at, need);
+    }
     if (got == -1) {
         ferr("Can't read input file.\n");
     }
+    Offset += got;
 
     End_buf = starting_at + got;
+    if (got > 0) {
+        ++Stats.fills;
+        Stats.bytes_read += got;
+    }
 
     if (got == 0) {
         Eof_read = 1;
@@ -292,34 +680,63 @@ int ii_fillbuf(unsigned char *starting_at)
 int ii_look(int n)
 {
     /* return the nth character of lookhead, EOF if you try to look past end
-     * of file, or 0 if you try to look past either end of the buffer */
+     * of file, or 0 if you try to look past either end of the buffer. Only
+     * Maxlook characters are sure to be in the buffer; past them, more is
+     * read, and since everything from sMark on is kept (the buffer grows if
+     * it must), any amount of lookahead fits unless there's a Maxlex limit.
+     * Don't call this on a buffer that's been terminated by ii_term().
+     *
+     * A read moves the text to the start of the buffer, or to a new one, as
+     * ii_advance() does: pointers from ii_text(), ii_ptext() and the
+     * ii_mark_*() routines are stale after looking past Maxlook characters.
+     * The marks themselves move with the text, so get them again. */
 
     unsigned char *p = Next + (n-1);
+    int ret;
+
+    while (p >= End_buf && !Eof_read) {
+        clear_sentinel();
+        ret = refill(false);
+        set_sentinel();
+        if (ret < 0) {
+            return 0;
+        }
+        p = Next + (n-1);
+    }
 
     if (Eof_read && p >= End_buf) {
         return EOF;
     }
 
-    return (p < Start_buf || p >= End_buf) ? 0 : *p;
+    if (p < Start_buf || p >= End_buf) {
+        return 0;
+    }
+
+    return (p == Sentinel) ? Saved : *p;
 }
 
 int ii_pusback(int n)
 {
     /* push n characters back into the input. You can't push past the current
      * sMark. You can, however, push back characters after end of file has
-     * been encountered. 
+     * been encountered. Line numbers are worked out when they're asked for,
+     * so this only moves Next, however far back it goes.
      *
      * 0 is returned if you try to push past the sMark, else 1 is returned.
      * */
-    while( --n >= 0 && Next > sMark) {
-        if (* --Next == '\n' || !*Next) {
-            Lineno --;
-        }
+    unsigned char *start = Next;
+
+    if (n > 0) {
+        Next = (n < Next - sMark) ? Next - n : sMark;
     }
 
     if (Next < eMark) {
         eMark = Next;
-        Mline = Lineno;
+    }
+
+    Stats.pushbacks += start - Next;
+    if (start - Next > Stats.max_pushback) {
+        Stats.max_pushback = start - Next;
     }
 
     return (Next > sMark);
@@ -329,6 +746,7 @@ int ii_pusback(int n)
  * support for '\0'-terminated strings */
 void ii_term()
 {
+    before_store();
     Termchar = *Next;
     *Next = '\0';
 }
@@ -361,11 +779,13 @@ int ii_uninput(unsigned char c)
     if (Termchar) {
         ii_unterm();
         if (ii_pusback(1)) {
+            before_store();
             *Next = c;
         }
         ii_term();
     } else {
         if (ii_pusback(1)) {
+            before_store();
             *Next = c;
             
         }
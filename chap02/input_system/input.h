@@ -0,0 +1,80 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Buffer geometry for ii_config(); zero fields take the defaults */
+typedef struct {
+    size_t bufsize;     /* input buffer size, at least 2 reads + lookahead */
+    size_t readsize;    /* bytes asked for by each read()                  */
+    int maxlook;        /* lookahead kept without a read, see ii_look()    */
+    size_t maxlex;      /* longest lexeme the buffer grows to, 0: no limit */
+} ii_config_t;
+
+/* A producer of input for ii_newsource(). read() works like read(2) but
+ * with arg in place of the file descriptor: it puts up to n bytes straight
+ * into the input buffer at buf and returns how many, 0 at end of input or -1
+ * on error. close(), if not NULL, is called when the input is closed. */
+typedef struct {
+    ssize_t (*read)(void *arg, unsigned char *buf, size_t n);
+    void (*close)(void *arg);
+    void *arg;
+} ii_source_t;
+
+/* initialization */
+int ii_config(const ii_config_t *cfg);
+int ii_newfile(char *filename);
+int ii_newsource(const ii_source_t *src);
+int ii_newbuffer(void *buf, size_t len);    /* buf[len] must be writable */
+void ii_readahead(bool on);
+
+/* access routines and marker movement */
+char *ii_text(void);
+int ii_length(void);
+int ii_lineno(void);
+char *ii_ptext(void);
+int ii_plength(void);
+int ii_plineno(void);
+int ii_bol(void);
+char *ii_mark_start(void);
+char *ii_mark_end(void);
+char *ii_move_start(void);
+char *ii_to_mark(void);
+char *ii_mark_prev(void);
+
+/* input */
+int ii_advance(void);
+int ii_flush(bool force);
+int ii_fillbuf(unsigned char *starting_at);
+int ii_look(int n);     /* past maxlook, moves the text like ii_advance() */
+int ii_pusback(int n);
+
+/* support for '\0'-terminated strings */
+void ii_term(void);
+void ii_unterm(void);
+int ii_input(void);
+int ii_uninput(unsigned char c);
+int ii_looahead(int n);
+int ii_flushbuf(void);
+
+/* Statistics, kept on the refill and marker paths only so they cost nothing
+ * per character. They're printed to stderr at exit if Verbose is set when a
+ * file is opened. */
+typedef struct {
+    long fills;         /* ii_fillbuf() calls that read something        */
+    long bytes_read;
+    long flushes;       /* times the buffer contents were shifted left   */
+    long bytes_moved;   /* bytes moved by those shifts                   */
+    long forced;        /* forced flushes that discarded saved lexemes   */
+    long max_lexeme;    /* longest lexeme marked with ii_mark_end()      */
+    long grows;         /* times the buffer was doubled for a lexeme     */
+    long pushbacks;     /* characters pushed back with ii_pusback()      */
+    long max_pushback;  /* most pushed back by a single ii_pusback()     */
+} ii_stats_t;
+
+const ii_stats_t *ii_stats(void);
+void ii_print_stats(FILE *fp);
+
+#endif /* end of include guard: INPUT_H */
@@ -0,0 +1,254 @@
+/* keyword.c -- a minimal perfect hash of the keywords, see keyword.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "tools/set.h"
+#include "compiler.h"
+
+#include "nfa.h"
+#include "dfa.h"
+#include "keyword.h"
+
+static KEYWORD *Tab;    /* the keywords */
+static int Nkw;
+static int *Seed;       /* Seed[bucket]: second hash seed for the bucket */
+static int *Slot;       /* Slot[hash]: the keyword's index in Tab        */
+static int *Group;      /* Group[i]: number of Tab[i].after, from 1      */
+static int Ngroups;
+
+static unsigned hash(const char *s, int len, unsigned seed)
+{
+    /* FNV-1a started from the seed. kw_print() writes out the same
+     * function. */
+    unsigned h = 2166136261u ^ (seed * 0x9e3779b9u);
+
+    while (--len >= 0) {
+        h = (h ^ (unsigned char)*s++) * 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+static void *allocate(size_t size)
+{
+    void *p = calloc(size, 1);
+
+    if (p == NULL) {
+        ferr("No memory for the keyword table!\n");
+    }
+    return p;
+}
+
+void kw_build(KEYWORD *tab, int n)
+{
+    /* Hash and displace. Each keyword goes in one of n buckets by its hash
+     * with seed 0. Then, biggest bucket first, find a seed that sends each
+     * keyword in the bucket to a slot of its own that no earlier bucket has
+     * taken, and keep the seed for the bucket. Looking a string up takes two
+     * hashes and a compare. The keywords must all be different. */
+    int *first, *next, *order, *size, *taken;
+    int i, j, b, k, nb, seed, ok, try = 0;
+
+    free(Seed);
+    free(Slot);
+    free(Group);
+    Tab = tab;
+    Nkw = n;
+    Seed = allocate((n + 1) * sizeof(int));
+    Slot = allocate((n + 1) * sizeof(int));
+    Group = allocate((n + 1) * sizeof(int));
+
+    /* Number the after strings, the same string the same number */
+    for (i = Ngroups = 0; i < n; ++i) {
+        for (j = 0; j < i && tab[j].after != tab[i].after; ++j) {
+            /* look for an earlier keyword with it */
+        }
+        Group[i] = (j < i) ? Group[j] : ++Ngroups;
+    }
+
+    first = allocate((n + 1) * sizeof(int));
+    next = allocate((n + 1) * sizeof(int));
+    order = allocate((n + 1) * sizeof(int));
+    size = allocate((n + 1) * sizeof(int));
+    taken = allocate((n + 1) * sizeof(int));
+
+    /* Put the keywords in buckets, each a list through next[] */
+    for (b = 0; b < n; ++b) {
+        first[b] = -1;
+        Slot[b] = -1;
+    }
+    for (i = 0; i < n; ++i) {
+        b = hash(tab[i].text, tab[i].len, 0) % n;
+        next[i] = first[b];
+        first[b] = i;
+        ++size[b];
+    }
+
+    /* Order the nonempty buckets by size, biggest first */
+    for (nb = 0, j = n; j > 0; --j) {
+        for (b = 0; b < n; ++b) {
+            if (size[b] == j) {
+                order[nb++] = b;
+            }
+        }
+    }
+
+    for (j = 0; j < nb; ++j) {
+        b = order[j];
+        for (seed = 1;; ++seed) {
+            /* taken[k] == try: slot k is used by this try already */
+            ++try;
+            ok = 1;
+            for (i = first[b]; i >= 0 && ok; i = next[i]) {
+                k = hash(tab[i].text, tab[i].len, seed) % n;
+                ok = (Slot[k] < 0 && taken[k] != try);
+                taken[k] = try;
+            }
+            if (ok) {
+                break;
+            }
+        }
+
+        Seed[b] = seed;
+        for (i = first[b]; i >= 0; i = next[i]) {
+            Slot[hash(tab[i].text, tab[i].len, seed) % n] = i;
+        }
+    }
+
+    free(first);
+    free(next);
+    free(order);
+    free(size);
+    free(taken);
+}
+
+int kw_lookup(const char *s, int len)
+{
+    int i;
+
+    if (Nkw == 0) {
+        return -1;
+    }
+
+    i = Slot[hash(s, len, Seed[hash(s, len, 0) % Nkw]) % Nkw];
+    return (Tab[i].len == len && !memcmp(Tab[i].text, s, len)) ? i : -1;
+}
+
+static void print_string(FILE *fp, const char *s, int len)
+{
+    /* Print s as a C string constant */
+    putc('"', fp);
+    for (; --len >= 0; ++s) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(fp, "\\%c", *s);
+        } else if (isprint((unsigned char)*s) && *s != '?') {
+            putc(*s, fp);
+        } else {
+            fprintf(fp, "\\%03o", (unsigned char)*s);
+        }
+    }
+    putc('"', fp);
+}
+
+static void print_match(FILE *fp, ACCEPT *accept, int nstates)
+{
+    /* Write out yykwmatch(): Yy_kwgroup[] has the number of each DFA state's
+     * accepting string if keywords are looked up after it, else 0, and
+     * Yy_kwafter[] the number each keyword is looked up after */
+    int i, s;
+
+    fprintf(fp, "static int Yy_kwgroup[%d] =\n{", nstates);
+    for (s = 0; s < nstates; ++s) {
+        for (i = 0; i < Nkw && (!accept[s].string ||
+                                Tab[i].after != accept[s].string); ++i) {
+            /* look for a keyword after it */
+        }
+        fprintf(fp, "%s%d,", s % 10 ? " " : "\n    ", i < Nkw ? Group[i] : 0);
+    }
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "static int Yy_kwafter[%d] =\n{", Nkw);
+    for (i = 0; i < Nkw; ++i) {
+        fprintf(fp, "%s%d,", i % 10 ? " " : "\n    ", Group[i]);
+    }
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp,
+        "int yykwmatch(int state, char *s, int len)\n"
+        "{\n"
+        "    int k;\n"
+        "\n"
+        "    if (!Yy_kwgroup[state] || (k = yykeyword(s, len)) < 0) {\n"
+        "        return -1;\n"
+        "    }\n"
+        "    return (Yy_kwafter[k] == Yy_kwgroup[state]) ? k : -1;\n"
+        "}\n");
+}
+
+void kw_print(FILE *fp, ACCEPT *accept, int nstates)
+{
+    /* Write the perfect hash as C source: yykeyword(s, len) returns the
+     * keyword's number (its index in the table from keywords()) or -1. When
+     * the DFA, with nstates states and accept as its accepting strings,
+     * accepts lexeme s in state state, the driver calls yykwmatch(state, s,
+     * len), and if it isn't -1 runs that keyword's action instead. */
+    int i;
+
+    fprintf(fp, "/* Keywords, looked up with a minimal perfect hash */\n\n");
+    if (Nkw == 0) {
+        fprintf(fp, "int yykeyword(char *s, int len)\n{\n    return -1;\n}\n\n"
+                    "int yykwmatch(int state, char *s, int len)\n"
+                    "{\n    return -1;\n}\n");
+        return;
+    }
+
+    fprintf(fp, "static int Yy_kwseed[%d] =\n{", Nkw);
+    for (i = 0; i < Nkw; ++i) {
+        fprintf(fp, "%s%d,", i % 10 ? " " : "\n    ", Seed[i]);
+    }
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "static int Yy_kwnum[%d] =\n{", Nkw);
+    for (i = 0; i < Nkw; ++i) {
+        fprintf(fp, "%s%d,", i % 10 ? " " : "\n    ", Slot[i]);
+    }
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "static int Yy_kwlen[%d] =\n{", Nkw);
+    for (i = 0; i < Nkw; ++i) {
+        fprintf(fp, "%s%d,", i % 10 ? " " : "\n    ", Tab[Slot[i]].len);
+    }
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "static char *Yy_kwtext[%d] =\n{\n", Nkw);
+    for (i = 0; i < Nkw; ++i) {
+        fprintf(fp, "    ");
+        print_string(fp, Tab[Slot[i]].text, Tab[Slot[i]].len);
+        fprintf(fp, ",\n");
+    }
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp,
+        "static unsigned yykwhash(char *s, int len, unsigned seed)\n"
+        "{\n"
+        "    unsigned h = 2166136261u ^ (seed * 0x9e3779b9u);\n"
+        "\n"
+        "    while (--len >= 0) {\n"
+        "        h = (h ^ (unsigned char)*s++) * 16777619u;\n"
+        "    }\n"
+        "    return h ^ (h >> 15);\n"
+        "}\n"
+        "\n"
+        "int yykeyword(char *s, int len)\n"
+        "{\n"
+        "    unsigned i = Yy_kwseed[yykwhash(s, len, 0) %% %d];\n"
+        "\n"
+        "    i = yykwhash(s, len, i) %% %d;\n"
+        "    return (Yy_kwlen[i] == len &&\n"
+        "            !memcmp(Yy_kwtext[i], s, len)) ? Yy_kwnum[i] : -1;\n"
+        "}\n\n", Nkw, Nkw);
+
+    print_match(fp, accept, nstates);
+}
@@ -0,0 +1,35 @@
+/* keyword.h
+ *
+ * Keywords: rules whose regular expression is a plain string, like "while",
+ * that some later rule (usually the one for identifiers) also matches. Each
+ * would add a chain of NFA states under the top-level OR and multiply the
+ * DFA states of that later rule, so thompson() leaves them out of the NFA
+ * instead. When the later rule's action is chosen, the lexeme is looked up
+ * in a minimal perfect hash of the keywords, and a keyword's own action is
+ * used if it's there. That gives the same result: both rules match exactly
+ * the same lexeme and the keyword, coming first, would have won.
+ *
+ * The scanner has to do that lookup, so this is only done when Hash_keywords
+ * is set (see globals.h) and the driver calls the yykwmatch() that kw_print()
+ * writes out. A keyword's number is its index in the table from keywords().
+ */
+
+struct accept;      /* dfa.h */
+
+typedef struct {
+    char *text;     /* the string the rule matches       */
+    int len;
+    char *accept;   /* its accepting string, from save() */
+    char *after;    /* accepting string of the rule it's looked up after */
+} KEYWORD;
+
+/* in nfa.c */
+int keywords(KEYWORD **tabp);   /* the keywords found by thompson() */
+
+/* in keyword.c */
+void kw_build(KEYWORD *tab, int n);
+int kw_lookup(const char *s, int len);  /* index in tab, or -1 */
+/* C source for yykeyword(s, len), the keyword's number or -1, and for
+ * yykwmatch(state, s, len): the number of the keyword that DFA state
+ * state's rule turns into for lexeme s, or -1 */
+void kw_print(FILE *fp, struct accept *accept, int nstates);
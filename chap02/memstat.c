@@ -0,0 +1,78 @@
+/* memstat.c -- per-category memory accounting, see memstat.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "globals.h"
+#include "memstat.h"
+
+static mem_usage Usage[MEM_NCATEGORIES];
+
+static char *Names[] = /* Indexed by mem_category */
+{
+    "NFA states",
+    "action strings",
+    "macros",
+    "character classes",
+    "DFA states",
+    "literal automata",
+};
+
+static void raise_peak(long *peak, long value)
+{
+    long old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+
+    while (value > old && !__atomic_compare_exchange_n(peak, &old, value,
+                true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        /* old has been reloaded, try again */
+    }
+}
+
+static void report_at_exit(void)
+{
+    mem_report(stderr);
+}
+
+void mem_add(mem_category cat, long bytes, long objects)
+{
+    /* Account for "objects" objects of "bytes" bytes in total; negative
+     * values release them. The report is printed at exit if Verbose is set
+     * the first time anything is accounted for. Rules are compiled on
+     * several threads, so only the one that swaps "registered" in does it;
+     * the load first keeps the rest from writing its cache line each time. */
+    static bool registered = false;
+    mem_usage *u = &Usage[cat];
+
+    if (!__atomic_load_n(&registered, __ATOMIC_RELAXED) &&
+        !__atomic_exchange_n(&registered, true, __ATOMIC_RELAXED) &&
+        Verbose) {
+        atexit(report_at_exit);
+    }
+
+    raise_peak(&u->peak_bytes,
+               __atomic_add_fetch(&u->bytes, bytes, __ATOMIC_RELAXED));
+    raise_peak(&u->peak_objects,
+               __atomic_add_fetch(&u->objects, objects, __ATOMIC_RELAXED));
+}
+
+const mem_usage *mem_stats(mem_category cat)
+{
+    return &Usage[cat];
+}
+
+void mem_report(FILE *fp)
+{
+    mem_usage *u;
+    long total = 0, peak = 0;
+
+    fprintf(fp, "%-20s %12s %12s %10s %10s\n", "memory", "bytes",
+            "peak bytes", "objects", "peak");
+    for (u = Usage; u < &Usage[MEM_NCATEGORIES]; ++u) {
+        fprintf(fp, "%-20s %12ld %12ld %10ld %10ld\n", Names[u - Usage],
+                u->bytes, u->peak_bytes, u->objects, u->peak_objects);
+        total += u->bytes;
+        peak += u->peak_bytes;
+    }
+    fprintf(fp, "%-20s %12ld %12ld\n", "total", total, peak);
+}
@@ -0,0 +1,30 @@
+/* memstat.h
+ *
+ * Memory accounting for the lexer generator. Each allocator reports what it
+ * hands out and takes back, by category; the current and peak bytes and
+ * object counts are kept per category. The counters are updated atomically,
+ * so rules may be compiled on several threads.
+ */
+
+#include <stdio.h>
+
+typedef enum {
+    MEM_NFA,        /* NFA states (new(), discard())       */
+    MEM_STRINGS,    /* accepting-action strings (save())   */
+    MEM_MACROS,     /* macro definitions (new_macro())     */
+    MEM_CCL,        /* character-class sets                */
+    MEM_DFA,        /* DFA states and rows (make_dtran())  */
+    MEM_AC,         /* literal-string automata (ac.c)      */
+    MEM_NCATEGORIES
+} mem_category;
+
+typedef struct {
+    long bytes;         /* in use now */
+    long peak_bytes;
+    long objects;
+    long peak_objects;
+} mem_usage;
+
+void mem_add(mem_category cat, long bytes, long objects);   /* < 0 frees */
+const mem_usage *mem_stats(mem_category cat);
+void mem_report(FILE *fp);
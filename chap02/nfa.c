@@ -1,32 +1,92 @@
 /* nfa.c -- Make a NFA from a LeX input file using Thompson's construction */
 
 #include <stdio.h>
-#include <stdio.h>
+#include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <setjmp.h>
 
-/* not yet have these headers below */
 #include "tools/debug.h"
 #include "tools/set.h"
 #include "tools/hash.h"
 #include "compiler.h"
-#include "stack.h"
-
 
 #include "nfa.h"
+#include "keyword.h"
+#include "ac.h"
 #include "globals.h"
+#include "trace.h"
+#include "memstat.h"
+
+
+/* Tracing is always compiled in and switched on with trace_enable(). Each
+ * event records the current lexeme and the position in the input line of
+ * the rule being compiled, "cp". */
+#define INPUT_OFFSET()  (cp->s_input ? (int)(cp->input - cp->s_input) : 0)
+#define ENTER(f)        TRACE(TR_ENTER, f, cp->lexeme, INPUT_OFFSET())
+#define LEAVE(f)        TRACE(TR_LEAVE, f, cp->lexeme, INPUT_OFFSET())
+
+/*-----------------------------------------------------------------------------
+ * The compiler context. Each rule is compiled on its own, into its own
+ * array of states, by whichever thread picks it up; everything the parser
+ * and its lexical analyzer used to keep in static variables is kept here
+ * instead. thompson() lays the rules' states out one after another, in rule
+ * order, and joins them with the top-level OR.
+ *---------------------------------------------------------------------------*/
+#define SSIZE 32
 
+typedef struct {
+    int lo, hi;                 /* code points lo through hi */
+} RANGE;
+
+typedef struct _compiler {
+    char *rule;                 /* the rule's text, as read by Ifunc   */
+    int lineno;                 /* Lineno when it was read            */
+    int actual_lineno;          /* Actual_lineno when it was read     */
+    uint64_t conds;             /* start conditions it's active in    */
+
+    /* lexical analyzer */
+    char *input;                /* current position in input string   */
+    char *s_input;              /* beginning of input string          */
+    int current_tok;            /* current token (a TOKEN)            */
+    int lexeme;                 /* value associated with LITERAL      */
+    int inquote;                /* processing quoted string           */
+    int got_line;               /* the rule has been handed to advance() */
+    char *stack[SSIZE];         /* input-source stack for macros      */
+    char **sp;                  /* stack pointer                      */
+
+    /* states */
+    nfa_state *states;          /* maxstates states for this rule     */
+    int maxstates;              /* room in states, at most NFA_MAX    */
+    jmp_buf *on_full;           /* where new() goes when it's used up */
+    int nstates;                /* # of states in use                 */
+    int next_alloc;             /* index of next element of the array */
+    nfa_state *sstack[SSIZE];   /* discarded states, used by new()    */
+    nfa_state **ssp;            /* their stack pointer                */
+
+    /* the result */
+    nfa_state *start;           /* start state of the rule's machine  */
+    nfa_state *end;             /* its accepting state                */
+    char *action;               /* accepting action, saved later      */
+
+    jmp_buf *on_error;          /* where parse_err() goes, NULL: exit */
+    int error;                  /* the ERR_NUM it was called with     */
+
+    /* keywords (see keyword.h) */
+    char *literal;              /* the string, if the rule is a plain one */
+    int len;
+    int after;                  /* rule it's looked up after, -1: none */
+    int lit;                    /* its value in the literal automaton, or
+                                   -1 (see ac.h) */
 
-#ifdef DEBUG
-    int Lev = 0;
-    #define ENTER(f) printf("%*senter %s [%c][%1.10s] \n", \
-                            Lev++ * 4, "", f, Lexeme, Input);
-    #define LEAVE(f) printf("%*sleave %s [%c][%1.10s]\n", \
-                            --Lev * 4, "", f, Lexeme, Input);
-#else
-    #define ENTER(f)
-    #define LEAVE(f)
-#endif
+    /* UTF-8 classes */
+    RANGE *ranges;              /* a class's code points beyond ASCII */
+    int nranges, maxranges;
+    SET *set;                   /* its ASCII members, until a state has
+                                   them; freed by nfa_compile() on error */
+} COMPILER;
 
 /*-----------------------------------------------------------------------------
  * Error processing stuff. Not that all errors are fatal.
@@ -40,12 +100,14 @@ typedef enum {
     E_BRACKET, /* Missing [ in character class" */
     E_BOL,     /* ^ must be at start of expression of after [" */
     E_CLOSE,   /* + ? or * must follow an expression or subexpression" */
-    E_STRINGS, /* Too many characters in accept actions" */
     E_NEWLINE, /* Newline in quoted string, use \\n to get new line into
                   expression" */
     E_BADMAC,  /* Missing } in macro expansion" */
     E_NOMAC,   /* Macro doesn't exist" */
     E_MACDEPTH,/* Macro expansion nested too deeply" */
+    E_UTF8,    /* Malformed UTF-8 character" */
+    E_NOCOND,  /* Start condition doesn't exist" */
+    E_TRAIL,   /* Trailing context needs r or s of fixed length" */
 } ERR_NUM;
 
 static char *Errmsgs[] = /* Indexed by ERR_NUM */
@@ -58,18 +120,31 @@ static char *Errmsgs[] = /* Indexed by ERR_NUM */
     "Missing [ in character class",
     "^ must be at start of expression of after [",
     "+ ? or * must follow an expression or subexpression",
-    "Too many characters in accept actions",
     "Newline in quoted string, use \\n to get new line into expression",
     "Missing } in macro expansion",
     "Macro doesn't exist",
     "Macro expansion nested too deeply",
+    "Malformed UTF-8 character",
+    "Start condition doesn't exist",
+    "Trailing context needs r or s of fixed length",
 };
 
-static void parse_err(ERR_NUM type)
+static void parse_err(COMPILER *cp, ERR_NUM type)
 {
-    fprintf(stderr, "ERROR (line %d) %s\n%s\n", Actual_lineno,
-            Errmsgs[(int)type], S_input);
-    while (++S_input <= Input) {
+    /* Errors are fatal, except to nfa_compile(), which returns them. The lock
+     * keeps two threads' messages apart. */
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    char *p;
+
+    if (cp->on_error) {
+        cp->error = type;
+        longjmp(*cp->on_error, 1);
+    }
+
+    pthread_mutex_lock(&lock);
+    fprintf(stderr, "ERROR (line %d) %s\n%s\n", cp->actual_lineno,
+            Errmsgs[(int)type], cp->s_input ? cp->s_input : "");
+    for (p = cp->s_input; p && ++p <= cp->input; ) {
         putc('_', stderr);
     }
 
@@ -80,81 +155,80 @@ static void parse_err(ERR_NUM type)
 /*-----------------------------------------------------------------------------
  * Memory management -- states and String
  *
- * 1. malloc a serious memory: Nfa_states.
+ * 1. malloc a serious memory for each rule: cp->states.
  * 2. Use a stack to manually save "freed" memory.
  * 3. when receiving allocation request, first check if the stack is not
  * empty, if not, that means we can re-use the memory it saves. Otherwise get
- * our memory from "Nfa_states".
+ * our memory from "cp->states".
+ * 4. The states point at each other, and the parser holds pointers to them,
+ * so cp->states can't be moved to make it bigger. When it's used up, new()
+ * goes back to compile(), which starts the rule again with twice the room.
  *---------------------------------------------------------------------------*/
-static nfa_state *Nfa_states;   /* state-machine array */
+static nfa_state *Nfa_states;   /* the whole machine, made by thompson() */
 static int Nstates = 0;         /* # of NFA states in machine */
-static int Next_alloc;          /* Index of next element of the array */
-
-#define SSIZE 32
-
-static nfa_state *Sstack[SSIZE];    /* Stack used by new() */
-static nfa_state **Sp = &Sstack[-1];    /* Stack pointer, i.e &(Sstack - 1) */
 
-#define STACK_OK    (INBOUNDS(Sstack, Sp)) /* true if stack not full or empty
-                                            */
-#define STACK_USED()    ((Sp-Sstack) + 1)   /* slots used */
-#define CLEAR_STACK()   (Sp = Sstack - 1)   /* reset the stack */
-#define PUSH(x)         (*++Sp = (x))       /* put x on stack */
-#define POP()           (*Sp --)            /* get x from stack */
+#define STACK_OK(cp)    (INBOUNDS((cp)->sstack, (cp)->ssp)) /* true if stack
+                                                    not full or empty */
+#define STACK_USED(cp)  (((cp)->ssp - (cp)->sstack) + 1)   /* slots used */
+#define CLEAR_STACK(cp) ((cp)->ssp = (cp)->sstack - 1)     /* reset it */
+#define PUSH(cp, x)     (*++(cp)->ssp = (x))    /* put x on stack */
+#define POP(cp)         (*(cp)->ssp --)         /* get x from stack */
 
-static int *Strings;    /* Place to save accepting strings */
+static int *Strings;    /* Place to save accepting strings, made by
+                           thompson() to fit them */
 static int *Savep;      /* Current position in String array. */
 
-static nfa_state *new()
+static nfa_state *new(COMPILER *cp)
 {
     nfa_state *p;
-    static int first_time = 1;
-    if (first_time) {
-        Nfa_states = (nfa_state *) calloc(NFA_MAX, sizeof(nfa_state));
-        if (Nfa_states == NULL) {
-            parse_err(E_MEM);
-        }
-        first_time = 0;
-        Sp = &Sstack[-1];
-    }
 
-    if (++Nstates >= NFA_MAX) {
-        parse_err(E_LENGTH);
+    if (++cp->nstates >= NFA_MAX) {
+        parse_err(cp, E_LENGTH);
     }
 
     /* if the stack is not OK, it's empty */
-    p = !STACK_OK() ? &Nfa_states[Next_alloc++] : POP();
+    if (!STACK_OK(cp) && cp->next_alloc >= cp->maxstates) {
+        longjmp(*cp->on_full, 1);
+    }
+    p = !STACK_OK(cp) ? &cp->states[cp->next_alloc++] : POP(cp);
     p->edge = EPSILON;
+    mem_add(MEM_NFA, sizeof(nfa_state), 1);
 
     return p;
 }
 
-static void discard(nfa_state *nfa_to_discard)
+static void discard(COMPILER *cp, nfa_state *nfa_to_discard)
 {
-    --Nstates;
+    --cp->nstates;
+    mem_add(MEM_NFA, -(long)sizeof(nfa_state), -1);
 
     memset(nfa_to_discard, 0, sizeof(*nfa_to_discard));
     nfa_to_discard->edge = EMPTY;
-    PUSH(nfa_to_discard);
-    if (! STACK_OK()) {
-        parse_err(E_STACK);
+    PUSH(cp, nfa_to_discard);
+    if (! STACK_OK(cp)) {
+        parse_err(cp, E_STACK);
+    }
+}
+
+/* string management function. The strings are saved in rule order by
+ * thompson(), not while the rules are compiled, because a "|" action refers
+ * to the string saved next. They are all in one array, so their addresses
+ * are in rule order too; scanners compare them to pick the earlier rule. */
+static int save_size(char *str)
+{
+    /* The ints save() takes for str */
+    int len = strlen(str) + 1;
+
+    if (*str == '|') {
+        return 0;
     }
+    return 1 + (len/sizeof(int)) + (len % sizeof(int) != 0);
 }
 
-/* string management function */
 static char *save(char *str)
 {
     char *textp, *startp;
     int len;
-    static int first_time = 1;
-
-    if (first_time) {
-        Savep = Strings = (int *)malloc(STR_MAX);
-        if (Savep == NULL) {
-            parse_err(E_MEM);
-        }
-        first_time = 0;
-    }
 
     if (*str == '|') {
         return (char*)(Savep + 1);
@@ -163,9 +237,7 @@ static char *save(char *str)
     *Savep++ = Lineno;
 
     for (textp = (char *)Savep; *str; *textp++=*str++) {
-        if (textp >= (char *)(Strings + (STR_MAX -1))) {
-            parse_err(E_STRINGS);
-        }
+        /* pass */
     }
 
     *textp++ = '\0';
@@ -179,6 +251,7 @@ static char *save(char *str)
     startp = (char *)Savep;
     len = textp - startp;
     Savep += (len/sizeof(int)) + (len % sizeof(int) != 0);
+    mem_add(MEM_STRINGS, (char *)Savep - startp + sizeof(int), 1);
     return startp;
 }
 
@@ -203,9 +276,6 @@ void new_macro(char *def)
      * whitespace at the end of the line is ignored.
      */
 
-    /* used for hash function */
-    unsigned hash_add(void);    /* TODO: figure out its usage */
-
     char *name;     /* name component of macro definition */
     char *text;     /* text part of macro definition */
     char *edef;     /* pointer to end of text part */
@@ -253,48 +323,53 @@ void new_macro(char *def)
 
     /* add the macro to the symbol table */
     p = (MACRO *) newsym(sizeof(MACRO));
+    mem_add(MEM_MACROS, sizeof(MACRO), 1);
     strncpy(p->name, name, MAC_NAME_MAX);
     strncpy(p->text, text, MAC_TEXT_MAX);
     addsym(Macros, p);
 }
 
-static char *expand_macro(char **namep)
+static char *expand_macro(COMPILER *cp, char **namep)
 {
     /* Return a pointer to the contents of a macro having the indicated name.
      * Abort with a message if no macro exits. The macro name includes the
-     * brackets, which are destroyed by the expansion process. *namep is
-     * modified to point past the close brace. 
+     * brackets. *namep is modified to point past the close brace. Neither
+     * the input nor the table is written here (the name is copied out, since
+     * it may be part of another macro's text), so rules can be compiled at
+     * the same time.
      */
 
+    char name[MAC_NAME_MAX];
     char *p = NULL;
     MACRO *mac = NULL;
 
     p = strchr(++(*namep), '}'); /* skip { and find } */
-    if (p == NULL) {
-        parse_err(E_BADMAC);
+    if (p == NULL || p - *namep >= MAC_NAME_MAX) {
+        parse_err(cp, E_BADMAC);
     } else {
-        *p++ = '\0';    /* Overwrite close brace */
+        memcpy(name, *namep, p - *namep);
+        name[p - *namep] = '\0';
 
-        mac = (MACRO *) findsym(Macros, *namep);
+        mac = Macros ? (MACRO *) findsym(Macros, name) : NULL;
         if (mac == NULL) {
-            parse_err(E_NOMAC);
+            parse_err(cp, E_NOMAC);
         }
 
-        *namep = p;
+        *namep = p + 1;
         return mac->text;
     }
     return "ERROR";     /* If you get here, it's a bug */
 }
 
-static print_a_macro(MACRO *mac)
+static void print_a_macro(MACRO *mac, void *param)
 {
-    /* Workhorse function function needed by ptab() call in printmacs(), below
-     */
-    print("%-16s--[%s]--\n", mac->name, mac->text);
+    /* Workhorse function function needed by ptab() call in print_macros(),
+     * below */
+    printf("%-16s--[%s]--\n", mac->name, mac->text);
 }
 
 /* print all macros to stdout */
-void printmacs()
+void print_macros(void)
 {
     if (!Macros) {
         printf("\tThere are no macros\n");
@@ -304,6 +379,120 @@ void printmacs()
     }
 }
 
+/*-----------------------------------------------------------------------------
+ * Start conditions
+ *
+ * A rule that starts with <A,B> is only active in start conditions A and B,
+ * and one that starts with <*> in all of them. Any other rule is active in
+ * INITIAL and every condition declared inclusive (%s); an exclusive one (%x)
+ * only has the rules that name it. thompson() gives each condition two
+ * start states, one for the middle of a line and one for its start, where
+ * the ^ rules are active as well, so neither a change of condition nor an
+ * anchor costs the scanner anything but the choice of start state.
+ *---------------------------------------------------------------------------*/
+#define COND_MAX 64     /* start conditions, the bits in a uint64_t */
+
+static char *Cond_names[COND_MAX] = { "INITIAL" };
+static int Nconds = 1;
+static uint64_t Exclusive;      /* the %x conditions */
+
+void new_condition(char *name, int exclusive)
+{
+    /* Declare a start condition, as a %s line does (or %x, if exclusive).
+     * Declaring one again just changes whether it's exclusive. */
+    int i;
+
+    for (i = 0; i < Nconds && strcmp(Cond_names[i], name); ++i) {
+        /* look for it */
+    }
+
+    if (i == Nconds) {
+        if (Nconds == COND_MAX) {
+            ferr("Too many start conditions (%d at most)\n", COND_MAX);
+        }
+        if ((Cond_names[Nconds++] = strdup(name)) == NULL) {
+            ferr("Not enough memeory for NFA\n");
+        }
+    }
+
+    if (exclusive) {
+        Exclusive |= (uint64_t)1 << i;
+    } else {
+        Exclusive &= ~((uint64_t)1 << i);
+    }
+}
+
+int conditions(char ***namesp)
+{
+    /* The start conditions' names, indexed by number; INITIAL is 0 */
+    *namesp = Cond_names;
+    return Nconds;
+}
+
+static uint64_t all_conds(void)
+{
+    return Nconds == COND_MAX ? ~(uint64_t)0 : ((uint64_t)1 << Nconds) - 1;
+}
+
+static char *start_conds(COMPILER *cp, char *rule)
+{
+    /* Set cp->conds to the start conditions of the rule at "rule" and return
+     * the rest of it. Without a list in front (or something that only looks
+     * like one, such as <=), they're the default ones and it's all rule. */
+    char *p, *name;
+    int i;
+
+    cp->conds = all_conds() & ~Exclusive;
+    if (*rule != '<') {
+        return rule;
+    }
+
+    /* Is it <name,...>? */
+    for (p = rule + 1;; ++p) {
+        if (*p == '*') {
+            ++p;
+        } else if (isalpha(*p) || *p == '_') {
+            while (isalnum(*p) || *p == '_') {
+                ++p;
+            }
+        } else {
+            return rule;
+        }
+
+        if (*p == '>') {
+            break;
+        } else if (*p != ',') {
+            return rule;
+        }
+    }
+
+    cp->conds = 0;
+    cp->s_input = rule;
+    for (p = rule + 1; *p != '>'; p += (*p == ',')) {
+        if (*p == '*') {
+            cp->conds = all_conds();
+            ++p;
+            continue;
+        }
+
+        for (name = p; isalnum(*p) || *p == '_'; ++p) {
+            /* find its end */
+        }
+        for (i = 0; i < Nconds && (strncmp(Cond_names[i], name, p - name) ||
+                                   Cond_names[i][p - name]); ++i) {
+            /* look it up */
+        }
+        if (i == Nconds) {
+            cp->input = p;
+            parse_err(cp, E_NOCOND);
+        }
+        cp->conds |= (uint64_t)1 << i;
+    }
+    cp->s_input = NULL;
+
+    return p + 1;
+}
+
 /*-----------------------------------------------------------------------------
  * LeX's own lexical analyzer
  *---------------------------------------------------------------------------*/
@@ -325,6 +514,7 @@ typedef enum {
     OPTIONAL,     /* ?                 */
     OR,           /* |                 */
     PLUS_CLOSE,   /* +                 */
+    CONTEXT,      /* /                 */
 } TOKEN;
 
 TOKEN Tokmap[] = 
@@ -341,11 +531,11 @@ TOKEN Tokmap[] =
 /*  (           )            *        +           ,  -     .    */
     OPEN_PAREN, CLOSE_PAREN, CLOSURE, PLUS_CLOSE, L, DASH, ANY,
 
-/*  /   0   1   2   3   4   5   6   7   8   9   :   ;   <   =   */
-    L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L, 
+/*  /        0   1   2   3   4   5   6   7   8   9   :   ;   <   */
+    CONTEXT, L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,
 
-/*  >   ?                                                       */
-    L,  OPTIONAL,
+/*  =   >   ?                                                   */
+    L,  L,  OPTIONAL,
 
 /*  @   A   B   C   D   E   F   G   H   I   J   K   L   M   N   */
     L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L, 
@@ -366,13 +556,7 @@ TOKEN Tokmap[] =
     OPEN_CURLY, OR, CLOSE_CURLY, L,
 };
 
-static char *(*Ifunc)();    /* Input function pointer */
-static char *Input = "";    /* current position in input string */
-static char *S_input;       /* Beginning of input string */
-static TOKEN Current_tok;   /* Current token */
-static int Lexeme;          /* Value associated with LITERAL */
-
-#define MATCH(t) (Current_tok == (t))
+#define MATCH(t) (cp->current_tok == (t))
 
 /*-----------------------------------------------------------------------------
  * Lexical analyzer:
@@ -380,103 +564,1470 @@ static int Lexeme;          /* Value associated with LITERAL */
  * Lexical analysis is trivial because all lexemes are single-character
  * values. The only complications are escape sequences and quoted strings,
  * both of which are handled by advance(), below. This routine advances past
- * the current token, putting the new token into Current_tok and the
- * equivalent lexeme into Lexeme. If the character was escaped, Lexeme holds
- * the actual value. For example, if a '\s' is encountered, Lexeme will hold a
- * space character. The MATCH(x) macro returns true if x matches the current
- * token. Advance both modifiers Current_tok to the current token and return
- * it. 
+ * the current token, putting the new token into cp->current_tok and the
+ * equivalent lexeme into cp->lexeme. If the character was escaped, lexeme
+ * holds the actual value. For example, if a '\s' is encountered, lexeme will
+ * hold a space character. The MATCH(x) macro returns true if x matches the
+ * current token. Advance both modifiers current_tok to the current token and
+ * return it. The input is the one rule in cp->rule; after it comes
+ * END_OF_INPUT.
  */
-static int advance(void)
+static int advance(COMPILER *cp)
 {
-    static int inquote = 0;    /* Processing quoted string */
     int saw_esc;               /* saw a backslash '\'      */
-    static char *stack[SSIZE]; /* input-source stack       */
-    static char **sp = NULL;   /* stack pointer            */
 
-    if (sp == NULL) {
-        /* initialize sp. Necessary for large model */
-        sp = stack - 1;
+    if (cp->current_tok == END_OF_INPUT) {
+        /* Nothing after the rule, a malformed one can ask again */
+        goto exit;
     }
 
     /* Get another line */
-    if (Current_tok == EOS) {
-        if (inquote) {
-            parse_err(E_NEWLINE);
+    if (cp->current_tok == EOS) {
+        if (cp->inquote) {
+            parse_err(cp, E_NEWLINE);
         }
 
-        do {
-            Input = Ifunc();
-            if (Input == NULL) {
-                Current_tok = END_OF_INPUT;
-                goto exit;
-            }
+        cp->input = cp->got_line ? NULL : cp->rule;
+        cp->got_line = 1;
+        if (cp->input == NULL) {
+            cp->current_tok = END_OF_INPUT;
+            goto exit;
+        }
 
-            /* ignoring leading space... and blank lines */
-            while (isspace(*Input)) {
-                Input ++;
-            }
-        } while ((*Input) == '\0');
+        /* ignoring leading space */
+        while (isspace(*cp->input)) {
+            cp->input ++;
+        }
 
-        S_input = Input;    /* Remember start of line for error messages. */
+        cp->s_input = cp->input;    /* Remember start of line for error
+                                       messages. */
     }
 
-    while (*Input == '\0') {
+    while (*cp->input == '\0') {
         /* Restore previous input source */
-        if (INBOUNDS(stack, sp)) {
-            INput = *sp--;
+        if (INBOUNDS(cp->stack, cp->sp)) {
+            cp->input = *cp->sp--;
             continue;
         }
 
-        Current_tok = EOS;  /* No more input sources to restore */
-        Lexeme = '\0';      /* i.e. you're at the real end of string */
+        cp->current_tok = EOS;  /* No more input sources to restore */
+        cp->lexeme = '\0';      /* i.e. you're at the real end of string */
         goto exit;
     }
 
-    if (!inquote) {
-        while (*Input == '{') {
+    if (!cp->inquote) {
+        while (*cp->input == '{') {
             /* Macro expansion required 
              * Stack current input string adn replace it with the macro body */
-            *++sp = Input;
-            Input = expand_macro(sp);
+            *++cp->sp = cp->input;
+            cp->input = expand_macro(cp, cp->sp);
 
-            if (TOOHIGH(stack, sp)) {
-                parse_err(E_MACDEPTH);  /* stack overflow */
+            if (TOOHIGH(cp->stack, cp->sp)) {
+                parse_err(cp, E_MACDEPTH);  /* stack overflow */
             }
         }
     }
 
     /* At either start and end of a quoted string. All characters are treated
      * as literals while inquote is true */
-    if (*Input == '"') {
-        inquote = ~inquote;
-        if (! *++Input) {
-            Current_tok = EOS;
-            Lexeme = '\0';
+    if (*cp->input == '"') {
+        cp->inquote = ~cp->inquote;
+        if (! *++cp->input) {
+            cp->current_tok = EOS;
+            cp->lexeme = '\0';
             goto exit;
         }
     }
 
-    saw_esc = (*Input == '\\');
+    saw_esc = (*cp->input == '\\');
 
-    if (!inquote) {
-        if (isspace(*Input)) {
-            Current_tok = EOS;
-            Lexeme = '\0';
+    if (!cp->inquote) {
+        if (isspace(*cp->input)) {
+            cp->current_tok = EOS;
+            cp->lexeme = '\0';
             goto exit;
         }
-        Lexeme = esc(&input);
+        cp->lexeme = (unsigned char) esc(&cp->input);
     } else {
-        if (saw_esc && Input[1] = '"') {
-            Input += 2;
-            Lexeme = '"';
+        if (saw_esc && cp->input[1] == '"') {
+            cp->input += 2;
+            cp->lexeme = '"';
         } else {
-            Lexeme = *Input ++;
+            cp->lexeme = (unsigned char) *cp->input ++;
         }
     }
 
-    Current_tok = (inquote || saw_esc) ? L : Tokmap[Lexeme];
+    /* Bytes past the table (DEL and anything beyond ASCII) are literals */
+    cp->current_tok = (cp->inquote || saw_esc ||
+                       cp->lexeme >= (int)(sizeof(Tokmap) / sizeof(TOKEN)))
+                      ? L : Tokmap[cp->lexeme];
 
 exit:
-    return Current_tok;
+    return cp->current_tok;
+}
+
+/*-----------------------------------------------------------------------------
+ * The parser:
+ *
+ *  rule     --> expr  EOS action
+ *               ^expr EOS action
+ *               expr$ EOS action
+ *               expr/expr EOS action     (trailing context, see nfa.h)
+ *  action   --> <tabs> <string of characters>
+ *               epsilon
+ *  expr     --> expr OR cat_expr
+ *               cat_expr
+ *  cat_expr --> cat_expr factor
+ *               factor
+ *  factor   --> term* | term+ | term? | term
+ *  term     --> [string] | [^string] | [] | [^] | . | (expr) | <character>
+ *
+ * The top level, machine --> rule machine | rule END_OF_INPUT, is done by
+ * thompson() once every rule has been compiled.
+ *---------------------------------------------------------------------------*/
+static void expr(COMPILER *cp, nfa_state **startp, nfa_state **endp);
+
+#define UNSEEN  -2      /* fixed_length() hasn't got to the state yet */
+#define BUSY    -3      /* it's working the state out                 */
+
+static int fixed_length(COMPILER *cp, nfa_state *p, nfa_state *end,
+                        int *len)
+{
+    /* The number of characters on every path from p to end, or -1 if the
+     * paths don't all have the same number (or there's a loop). len[i] is
+     * the answer for cp->states[i], or UNSEEN or BUSY. */
+    int *lp = &len[p - cp->states], n;
+
+    if (p == end) {
+        return 0;
+    }
+    if (*lp != UNSEEN) {
+        return (*lp == BUSY) ? -1 : *lp;
+    }
+
+    *lp = BUSY;
+    if (p->next == NULL) {
+        n = -1;
+    } else if (p->edge != EPSILON) {
+        n = fixed_length(cp, p->next, end, len);
+        n = (n < 0) ? -1 : n + 1;
+    } else {
+        n = fixed_length(cp, p->next, end, len);
+        if (p->next2 && fixed_length(cp, p->next2, end, len) != n) {
+            n = -1;
+        }
+    }
+    return *lp = n;
+}
+
+static int length_of(COMPILER *cp, nfa_state *start, nfa_state *end)
+{
+    /* The length of every string the machine from start to end matches, or
+     * -1 if they aren't all the same length */
+    int len[NFA_MAX], i;
+
+    for (i = 0; i < cp->next_alloc; ++i) {
+        len[i] = UNSEEN;
+    }
+    return fixed_length(cp, start, end, len);
+}
+
+static void rule(COMPILER *cp)
+{
+    /* Compile cp->rule, leaving its machine in cp->start and cp->end and its
+     * action in cp->action. */
+    nfa_state *start = NULL, *end = NULL, *head, *s_start, *s_end;
+    int anchor = NONE, trail = 0, r_len, s_len;
+
+    ENTER("rule");
+
+    if (MATCH(AT_BOL)) {
+        start = new(cp);
+        start->edge = '\n';
+        anchor |= START;
+        advance(cp);
+        expr(cp, &start->next, &end);
+        head = start->next;
+    } else {
+        expr(cp, &start, &end);
+        head = start;
+    }
+
+    if (MATCH(CONTEXT)) {
+        /* r/s: s is concatenated to r like any other expression, and where
+         * the lexeme ends is worked out from whichever has a fixed length */
+        advance(cp);
+        r_len = length_of(cp, head, end);
+        expr(cp, &s_start, &s_end);
+        if (MATCH(CONTEXT)) {
+            parse_err(cp, E_BADEXPR);   /* a/b/c */
+        }
+        s_len = length_of(cp, s_start, s_end);
+
+        if (s_len >= 0) {
+            trail = s_len;
+        } else if (r_len > 0) {
+            trail = -r_len;
+        } else {
+            parse_err(cp, E_TRAIL);
+        }
+
+        memcpy(end, s_start, sizeof(nfa_state));
+        discard(cp, s_start);
+        end = s_end;
+        anchor |= TRAIL;
+    }
+
+    if (MATCH(AT_EOL)) {
+        /* pattern followed by a carriage-return or linefeed (use a character
+         * class). */
+        advance(cp);
+        end->next = new(cp);
+        end->edge = CCL;
+
+        if (!(end->bitset = newset())) {
+            parse_err(cp, E_MEM);
+        }
+        mem_add(MEM_CCL, sizeof(SET), 1);
+
+        ADD(end->bitset, '\n');
+        if (!Unix) {
+            ADD(end->bitset, '\r');
+        }
+
+        end = end->next;
+        anchor |= END;
+        if (trail >= 0) {
+            ++trail;        /* the newline is trailing context too */
+        }
+    }
+
+    while (isspace(*cp->input)) {
+        ++cp->input;
+    }
+
+    cp->action = cp->input;
+    end->anchor = anchor;
+    end->trail = trail;
+    cp->start = start;
+    cp->end = end;
+    advance(cp);    /* skip past EOS */
+
+    LEAVE("rule");
+}
+
+static int first_in_cat(COMPILER *cp, int tok)
+{
+    switch (tok) {
+        case CLOSE_PAREN:
+        case AT_EOL:
+        case CONTEXT:
+        case OR:
+        case EOS:
+            return 0;
+
+        case CLOSURE:
+        case PLUS_CLOSE:
+        case OPTIONAL:
+            parse_err(cp, E_CLOSE);
+            return 0;
+
+        case CCL_END:
+            parse_err(cp, E_BRACKET);
+            return 0;
+
+        case AT_BOL:
+            parse_err(cp, E_BOL);
+            return 0;
+    }
+
+    return 1;
+}
+
+/*-----------------------------------------------------------------------------
+ * UTF-8 character classes (see Utf8 in globals.h)
+ *
+ * With Utf8 set, a class, a dot or a character beyond ASCII is a set of
+ * Unicode code points. Its ASCII members go in one CCL state, as always. The
+ * rest are split into ranges whose UTF-8 encodings are all the same length
+ * and differ only within one range of values at each byte position, and
+ * each of those becomes a chain of states, one byte range a state. The DFA
+ * still takes a byte a step and nothing is decoded while scanning.
+ *
+ * The chains are made from their last byte back, through a cache of (byte
+ * range, next state) pairs, so chains that end alike share their states:
+ * each range of a big class ends in [\x80-\xBF] to the end state, and most
+ * end in two or three of them.
+ *---------------------------------------------------------------------------*/
+#define UTF8_MAX 0x10FFFF   /* biggest code point */
+#define UCACHE 256          /* suffix-cache entries, a power of 2 */
+
+typedef struct {
+    int lo, hi;             /* the bytes lo through hi          */
+    nfa_state *next;        /* going to next                    */
+    nfa_state *state;       /* are this state's edge, or NULL   */
+} SUFFIX;
+
+typedef struct {
+    nfa_state *end;         /* where every chain goes           */
+    nfa_state **hole;       /* where the next chain is put      */
+    SUFFIX cache[UCACHE];
+} UCLASS;
+
+static int code_point(COMPILER *cp)
+{
+    /* The code point whose UTF-8 encoding starts with the current lexeme.
+     * The rest of the encoding is read, so its last byte is current when
+     * this returns. Without Utf8 the lexeme is the character. */
+    int c = cp->lexeme, n = 0, min = 0;
+
+    if (!Utf8 || c < 0x80) {
+        return c;
+    }
+
+    if (c >= 0xC2 && c <= 0xDF) {
+        n = 1, c &= 0x1F, min = 0x80;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 2, c &= 0x0F, min = 0x800;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 3, c &= 0x07, min = 0x10000;
+    } else {
+        parse_err(cp, E_UTF8);
+    }
+
+    while (--n >= 0) {
+        advance(cp);
+        if (!MATCH(L) || (cp->lexeme & 0xC0) != 0x80) {
+            parse_err(cp, E_UTF8);
+        }
+        c = (c << 6) | (cp->lexeme & 0x3F);
+    }
+
+    if (c < min || c > UTF8_MAX || (c >= 0xD800 && c <= 0xDFFF)) {
+        parse_err(cp, E_UTF8);  /* overlong, too big or a surrogate */
+    }
+    return c;
+}
+
+static void add_range(COMPILER *cp, SET *set, int lo, int hi)
+{
+    /* Add lo through hi to a class: ASCII (or, without Utf8, everything) to
+     * the set and the rest to cp->ranges */
+    for (; lo <= hi && (lo < 0x80 || !Utf8); ++lo) {
+        ADD(set, lo);
+    }
+    if (lo > hi) {
+        return;
+    }
+
+    if (cp->nranges == cp->maxranges) {
+        cp->maxranges = cp->maxranges ? 2 * cp->maxranges : 16;
+        cp->ranges = (RANGE *) realloc(cp->ranges,
+                                       cp->maxranges * sizeof(RANGE));
+        if (cp->ranges == NULL) {
+            parse_err(cp, E_MEM);
+        }
+    }
+    cp->ranges[cp->nranges].lo = lo;
+    cp->ranges[cp->nranges++].hi = hi;
+}
+
+static int cmp_range(const void *a, const void *b)
+{
+    return ((const RANGE *)a)->lo - ((const RANGE *)b)->lo;
+}
+
+static void merge_ranges(COMPILER *cp, int negate)
+{
+    /* Sort cp->ranges and merge the ones that overlap or touch. If negate,
+     * replace them by the code points beyond ASCII they leave out. */
+    RANGE *r = cp->ranges;
+    int n = cp->nranges, i, j, lo;
+
+    if (n > 1) {
+        qsort(r, n, sizeof(RANGE), cmp_range);
+    }
+    for (i = 0, j = -1; i < n; ++i) {
+        if (j >= 0 && r[i].lo <= r[j].hi + 1) {
+            if (r[i].hi > r[j].hi) {
+                r[j].hi = r[i].hi;
+            }
+        } else {
+            r[++j] = r[i];
+        }
+    }
+    n = j + 1;
+
+    if (negate) {
+        cp->ranges = NULL;
+        cp->nranges = cp->maxranges = 0;
+        for (i = 0, lo = 0x80; i < n; lo = r[i++].hi + 1) {
+            if (r[i].lo > lo) {
+                add_range(cp, NULL, lo, r[i].lo - 1);
+            }
+        }
+        if (lo <= UTF8_MAX) {
+            add_range(cp, NULL, lo, UTF8_MAX);
+        }
+        free(r);
+    } else {
+        cp->nranges = n;
+    }
+}
+
+static void alternative(COMPILER *cp, UCLASS *uc, nfa_state *p)
+{
+    /* Make p one more of the states the class starts with */
+    nfa_state *split;
+
+    if (*uc->hole == NULL) {
+        *uc->hole = p;
+        return;
+    }
+
+    split = new(cp);
+    split->next = *uc->hole;
+    split->next2 = p;
+    *uc->hole = split;
+    uc->hole = &split->next2;
+}
+
+static nfa_state *suffix(COMPILER *cp, UCLASS *uc, int lo, int hi,
+                         nfa_state *next)
+{
+    /* The state going to next on the bytes lo through hi; another chain's,
+     * if it has one */
+    SUFFIX *e = &uc->cache[(lo * 31 + hi * 7 + (int)(next - cp->states))
+                           & (UCACHE - 1)];
+    nfa_state *p;
+    int c;
+
+    if (e->state && e->lo == lo && e->hi == hi && e->next == next) {
+        return e->state;
+    }
+
+    p = new(cp);
+    p->next = next;
+    if (lo == hi) {
+        p->edge = lo;
+    } else {
+        p->edge = CCL;
+        if (!(p->bitset = newset())) {
+            parse_err(cp, E_MEM);
+        }
+        mem_add(MEM_CCL, sizeof(SET), 1);
+        for (c = lo; c <= hi; ++c) {
+            ADD(p->bitset, c);
+        }
+    }
+
+    e->lo = lo;
+    e->hi = hi;
+    e->next = next;
+    e->state = p;
+    return p;
+}
+
+static int encode(int c, int *b)
+{
+    /* Put the UTF-8 encoding of c, 0x80 or more, in b; return its length */
+    if (c < 0x800) {
+        b[0] = 0xC0 | (c >> 6);
+        b[1] = 0x80 | (c & 0x3F);
+        return 2;
+    }
+    if (c < 0x10000) {
+        b[0] = 0xE0 | (c >> 12);
+        b[1] = 0x80 | ((c >> 6) & 0x3F);
+        b[2] = 0x80 | (c & 0x3F);
+        return 3;
+    }
+    b[0] = 0xF0 | (c >> 18);
+    b[1] = 0x80 | ((c >> 12) & 0x3F);
+    b[2] = 0x80 | ((c >> 6) & 0x3F);
+    b[3] = 0x80 | (c & 0x3F);
+    return 4;
+}
+
+static void utf8_range(COMPILER *cp, UCLASS *uc, int lo, int hi)
+{
+    /* Add chains for the code points lo through hi, all beyond ASCII.
+     * Split the range until lo's and hi's encodings are the same length and
+     * every code point between has, at each position, a byte between theirs;
+     * then one chain of byte ranges matches exactly those code points. */
+    static int longest[] = { 0x7FF, 0xFFFF };   /* by encoded length */
+    int blo[4], bhi[4], i, m, n;
+    nfa_state *p;
+
+    if (lo <= 0xDFFF && hi >= 0xD800) {
+        /* surrogates aren't characters */
+        if (lo < 0xD800) {
+            utf8_range(cp, uc, lo, 0xD7FF);
+        }
+        if (hi > 0xDFFF) {
+            utf8_range(cp, uc, 0xE000, hi);
+        }
+        return;
+    }
+
+    for (i = 0; i < 2; ++i) {
+        if (lo <= longest[i] && hi > longest[i]) {
+            utf8_range(cp, uc, lo, longest[i]);
+            utf8_range(cp, uc, longest[i] + 1, hi);
+            return;
+        }
+    }
+
+    for (i = 1; i < 4; ++i) {
+        /* m: the bits in the last i bytes */
+        m = (1 << (6 * i)) - 1;
+        if ((lo & ~m) != (hi & ~m)) {
+            if ((lo & m) != 0) {
+                utf8_range(cp, uc, lo, lo | m);
+                utf8_range(cp, uc, (lo | m) + 1, hi);
+                return;
+            }
+            if ((hi & m) != m) {
+                utf8_range(cp, uc, lo, (hi & ~m) - 1);
+                utf8_range(cp, uc, hi & ~m, hi);
+                return;
+            }
+        }
+    }
+
+    n = encode(lo, blo);
+    encode(hi, bhi);
+    for (p = uc->end, i = n; --i >= 0;) {
+        p = suffix(cp, uc, blo[i], bhi[i], p);
+    }
+    alternative(cp, uc, p);
+}
+
+static void dodash(COMPILER *cp, SET *set)
+{
+    int first = 0, c;
+
+    if (MATCH(DASH)) {
+        /* Treat [-...] as a literal dash */
+        add_range(cp, set, '-', '-');
+        advance(cp);
+    }
+
+    for (; !MATCH(EOS) && !MATCH(CCL_END); advance(cp)) {
+        if (!MATCH(DASH)) {
+            first = code_point(cp);
+            add_range(cp, set, first, first);
+        } else {
+            /* looking at a dash */
+            advance(cp);
+            if (MATCH(EOS)) {
+                break;      /* [a- runs off the rule, the caller reports it */
+            }
+            if (MATCH(CCL_END)) {
+                /* Treat [...-] as literal */
+                add_range(cp, set, '-', '-');
+                break;
+            }
+            c = code_point(cp);
+            add_range(cp, set, first, c);
+        }
+    }
+}
+
+static void utf8_term(COMPILER *cp, nfa_state **startp, nfa_state **endp)
+{
+    /* A class, a dot or a character beyond ASCII, with Utf8 set */
+    nfa_state *p;
+    UCLASS uc;
+    SET *set, *ascii;
+    int negate = 0, c, i;
+
+    if (!(cp->set = set = newset())) {
+        parse_err(cp, E_MEM);
+    }
+    mem_add(MEM_CCL, sizeof(SET), 1);
+    cp->nranges = 0;
+
+    if (MATCH(ANY)) {
+        negate = 1;
+    } else if (MATCH(CCL_START)) {
+        advance(cp);
+        if (MATCH(AT_BOL)) {
+            /* Negative character class */
+            advance(cp);
+            negate = 1;
+        }
+
+        if (!MATCH(CCL_END)) {
+            dodash(cp, set);
+            if (!MATCH(CCL_END)) {
+                parse_err(cp, E_BADEXPR);   /* no ] */
+            }
+        } else {
+            /* [] or [^] */
+            add_range(cp, set, 0, ' ');
+        }
+    } else {
+        c = code_point(cp);
+        add_range(cp, set, c, c);
+    }
+    advance(cp);
+
+    if (negate) {
+        /* Don't include \n in class. COMPLEMENT() would take in the bytes
+         * beyond ASCII too, so the ASCII members are counted out. */
+        ADD(set, '\n');
+        if (!Unix) {
+            ADD(set, '\r');
+        }
+        if (!(ascii = newset())) {
+            parse_err(cp, E_MEM);
+        }
+        for (c = 0; c < 0x80; ++c) {
+            if (!TEST(set, c)) {
+                ADD(ascii, c);
+            }
+        }
+        delset(set);
+        cp->set = set = ascii;
+    }
+    merge_ranges(cp, negate);
+
+    memset(&uc, 0, sizeof(uc));
+    *endp = uc.end = new(cp);
+    *startp = NULL;
+    uc.hole = startp;
+
+    for (c = 0; c < 0x80 && !TEST(set, c); ++c) {
+        /* pass */
+    }
+    if (c < 0x80 || cp->nranges == 0) {
+        p = new(cp);
+        p->edge = CCL;
+        p->bitset = set;
+        cp->set = NULL;
+        p->next = uc.end;
+        alternative(cp, &uc, p);
+    } else {
+        delset(set);
+        cp->set = NULL;
+        mem_add(MEM_CCL, -(long)sizeof(SET), -1);
+    }
+
+    for (i = 0; i < cp->nranges; ++i) {
+        utf8_range(cp, &uc, cp->ranges[i].lo, cp->ranges[i].hi);
+    }
+}
+
+static void term(COMPILER *cp, nfa_state **startp, nfa_state **endp)
+{
+    /* Process the term productions:
+     *
+     * term --> [...] | [^...] | [] | [^] | . | (expr) | <character>
+     *
+     * The [] is nonstandard. It matches a space, tab, formfeed, or newline,
+     * but not a carriage return (\r). All of these are single nodes in the
+     * NFA, except with Utf8 set, when utf8_term() does classes, dots and
+     * characters beyond ASCII. */
+    nfa_state *start;
+    int c;
+
+    ENTER("term");
+
+    if (MATCH(OPEN_PAREN)) {
+        advance(cp);
+        expr(cp, startp, endp);
+        if (MATCH(CLOSE_PAREN)) {
+            advance(cp);
+        } else {
+            parse_err(cp, E_PAREN);
+        }
+    } else if (Utf8 && (MATCH(ANY) || MATCH(CCL_START) ||
+                        cp->lexeme >= 0x80)) {
+        utf8_term(cp, startp, endp);
+    } else {
+        *startp = start = new(cp);
+        *endp = start->next = new(cp);
+
+        if (!(MATCH(ANY) || MATCH(CCL_START))) {
+            start->edge = cp->lexeme;
+            advance(cp);
+        } else {
+            start->edge = CCL;
+
+            if (!(start->bitset = newset())) {
+                parse_err(cp, E_MEM);
+            }
+            mem_add(MEM_CCL, sizeof(SET), 1);
+
+            if (MATCH(ANY)) {
+                /* dot (.) */
+                ADD(start->bitset, '\n');
+                if (!Unix) {
+                    ADD(start->bitset, '\r');
+                }
+                COMPLEMENT(start->bitset);
+            } else {
+                advance(cp);
+                if (MATCH(AT_BOL)) {
+                    /* Negative character class */
+                    advance(cp);
+
+                    /* Don't include \n in class */
+                    ADD(start->bitset, '\n');
+                    if (!Unix) {
+                        ADD(start->bitset, '\r');
+                    }
+                    COMPLEMENT(start->bitset);
+                }
+
+                if (!MATCH(CCL_END)) {
+                    dodash(cp, start->bitset);
+                    if (!MATCH(CCL_END)) {
+                        parse_err(cp, E_BADEXPR);   /* no ] */
+                    }
+                } else {
+                    /* [] or [^] */
+                    for (c = 0; c <= ' '; ++c) {
+                        ADD(start->bitset, c);
+                    }
+                }
+            }
+            advance(cp);
+        }
+    }
+
+    LEAVE("term");
+}
+
+static void factor(COMPILER *cp, nfa_state **startp, nfa_state **endp)
+{
+    /* factor --> term* | term+ | term? */
+    nfa_state *start, *end;
+
+    ENTER("factor");
+
+    term(cp, startp, endp);
+
+    if (MATCH(CLOSURE) || MATCH(PLUS_CLOSE) || MATCH(OPTIONAL)) {
+        start = new(cp);
+        end = new(cp);
+        start->next = *startp;
+        (*endp)->next = end;
+
+        if (MATCH(CLOSURE) || MATCH(OPTIONAL)) {
+            /* * or ? */
+            start->next2 = end;
+        }
+
+        if (MATCH(CLOSURE) || MATCH(PLUS_CLOSE)) {
+            /* * or + */
+            (*endp)->next2 = *startp;
+        }
+
+        *startp = start;
+        *endp = end;
+        advance(cp);
+    }
+
+    LEAVE("factor");
+}
+
+static void cat_expr(COMPILER *cp, nfa_state **startp, nfa_state **endp)
+{
+    /* The same translations that were needed in the expr rules are needed
+     * again here:
+     *
+     *  cat_expr  -> cat_expr | factor
+     *               factor
+     *
+     * is translated to:
+     *
+     *  cat_expr  -> factor cat_expr'
+     *  cat_expr' -> | factor cat_expr'
+     *               epsilon
+     */
+    nfa_state *e2_start, *e2_end;
+
+    ENTER("cat_expr");
+
+    if (first_in_cat(cp, cp->current_tok)) {
+        factor(cp, startp, endp);
+    } else {
+        parse_err(cp, E_BADEXPR);   /* nothing there, as in "a|" or "()" */
+    }
+
+    while (first_in_cat(cp, cp->current_tok)) {
+        factor(cp, &e2_start, &e2_end);
+        memcpy(*endp, e2_start, sizeof(nfa_state));
+        discard(cp, e2_start);
+        *endp = e2_end;
+    }
+
+    LEAVE("cat_expr");
+}
+
+static void expr(COMPILER *cp, nfa_state **startp, nfa_state **endp)
+{
+    /* Because a recursive descent compiler can't handle left recursion, the
+     * productions:
+     *
+     *  expr  -> expr OR cat_expr
+     *           cat_expr
+     *
+     * must be translated into:
+     *
+     *  expr  -> cat_expr expr'
+     *  expr' -> OR cat_expr expr'
+     *           epsilon
+     *
+     * which can be implemented with this loop:
+     *
+     *  cat_expr
+     *  while (match(OR))
+     *      cat_expr
+     *      do the OR
+     */
+    nfa_state *e2_start = NULL;    /* expression to right of | */
+    nfa_state *e2_end = NULL;
+    nfa_state *p;
+
+    ENTER("expr");
+
+    cat_expr(cp, startp, endp);
+
+    while (MATCH(OR)) {
+        advance(cp);
+        cat_expr(cp, &e2_start, &e2_end);
+
+        p = new(cp);
+        p->next2 = e2_start;
+        p->next = *startp;
+        *startp = p;
+
+        p = new(cp);
+        (*endp)->next = p;
+        e2_end->next = p;
+        *endp = p;
+    }
+
+    LEAVE("expr");
+}
+
+/*-----------------------------------------------------------------------------
+ * Compiling the rules and putting them together
+ *---------------------------------------------------------------------------*/
+static COMPILER *Rules;     /* one per rule, in input order */
+static int Nrules;
+static int Next_rule;       /* next rule to be compiled */
+
+#define NFA_FIRST 16       /* states a rule is first given room for */
+
+static void compile(COMPILER *cp)
+{
+    jmp_buf full;
+
+    cp->maxstates = NFA_FIRST;
+    cp->on_full = &full;
+    if (setjmp(full)) {
+        /* new() ran out of room: throw the machine away and start again */
+        nfa_free(cp->states, cp->next_alloc);
+        if (cp->set) {
+            delset(cp->set);
+            mem_add(MEM_CCL, -(long)sizeof(SET), -1);
+            cp->set = NULL;
+        }
+        cp->nranges = 0;
+        cp->maxstates = (cp->maxstates * 2 < NFA_MAX) ? cp->maxstates * 2
+                                                      : NFA_MAX;
+    }
+
+    cp->states = (nfa_state *) calloc(cp->maxstates, sizeof(nfa_state));
+    if (cp->states == NULL) {
+        parse_err(cp, E_MEM);
+    }
+    cp->nstates = cp->next_alloc = 0;
+    cp->inquote = cp->got_line = 0;
+
+    cp->sp = cp->stack - 1;
+    CLEAR_STACK(cp);
+    cp->current_tok = EOS;  /* Load first token */
+    advance(cp);
+    rule(cp);
+
+    free(cp->ranges);
+    cp->ranges = NULL;
+}
+
+static void *compile_rules(void *arg)
+{
+    /* Compile rules until there are none left */
+    int i;
+
+    while ((i = __atomic_fetch_add(&Next_rule, 1, __ATOMIC_RELAXED)) < Nrules) {
+        compile(&Rules[i]);
+    }
+    return NULL;
+}
+
+static nfa_state *relocate(nfa_state *p, COMPILER *cp, nfa_state *base)
+{
+    /* Where p, a state of cp's, is once its states are copied to base */
+    return p ? base + (p - cp->states) : NULL;
+}
+
+static void move_states(COMPILER *cp, nfa_state *base)
+{
+    /* Move cp's states to base, which has room for cp->next_alloc of them */
+    nfa_state *p, *q;
+    int j;
+
+    for (j = 0; j < cp->next_alloc; ++j) {
+        p = &base[j];
+        q = &cp->states[j];
+        *p = *q;
+        p->next = relocate(q->next, cp, base);
+        p->next2 = relocate(q->next2, cp, base);
+    }
+
+    cp->start = relocate(cp->start, cp, base);
+    cp->end = relocate(cp->end, cp, base);
+    free(cp->states);
+    cp->states = base;
+}
+
+/*-----------------------------------------------------------------------------
+ * Keywords
+ *---------------------------------------------------------------------------*/
+static KEYWORD *Keywords;   /* in rule order */
+static int Nkeywords;
+
+int keywords(KEYWORD **tabp)
+{
+    *tabp = Keywords;
+    return Nkeywords;
+}
+
+static int literal(COMPILER *cp)
+{
+    /* If rule cp's regular expression is a plain string, with no anchors,
+     * put the string in cp->literal and return true. */
+    nfa_state *p;
+    int len = 0;
+
+    if (cp->end->anchor != NONE) {
+        return 0;
+    }
+    for (p = cp->start; p != cp->end; p = p->next, ++len) {
+        if (p->edge < 0 || p->next2) {
+            return 0;   /* not a single character */
+        }
+    }
+
+    if ((cp->literal = (char *) malloc(len + 1)) == NULL) {
+        ferr("Not enough memeory for NFA\n");
+    }
+    for (p = cp->start, len = 0; p != cp->end; p = p->next) {
+        cp->literal[len++] = p->edge;
+    }
+    cp->literal[len] = '\0';
+    cp->len = len;
+    return 1;
+}
+
+static void e_closure(COMPILER *cp, char *set, int *stack)
+{
+    /* Add to "set" the states of cp reached from it on epsilon edges */
+    int *sp = stack, i;
+    nfa_state *p;
+
+    for (i = 0; i < cp->next_alloc; ++i) {
+        if (set[i]) {
+            *sp++ = i;
+        }
+    }
+
+    while (sp > stack) {
+        p = &cp->states[*--sp];
+        if (p->edge == EPSILON) {
+            if (p->next && !set[i = p->next - cp->states]) {
+                set[i] = 1;
+                *sp++ = i;
+            }
+            if (p->next2 && !set[i = p->next2 - cp->states]) {
+                set[i] = 1;
+                *sp++ = i;
+            }
+        }
+    }
+}
+
+static int matches(COMPILER *cp, char *s, int len)
+{
+    /* True if rule cp's machine matches all of s, anchors or not */
+    int n = cp->next_alloc, found = 1, stack[n], c, i;
+    char set[n], to[n];
+    nfa_state *p;
+
+    memset(set, 0, n);
+    p = (cp->end->anchor & START) ? cp->start->next : cp->start;
+    set[p - cp->states] = 1;
+    e_closure(cp, set, stack);
+
+    for (; len > 0 && found; --len) {
+        c = (unsigned char)*s++;
+        memset(to, 0, n);
+        found = 0;
+        for (i = 0; i < n; ++i) {
+            p = &cp->states[i];
+            if (set[i] && p->next && (p->edge == c ||
+                            (p->edge == CCL && TEST(p->bitset, c)))) {
+                to[p->next - cp->states] = found = 1;
+            }
+        }
+        e_closure(cp, to, stack);
+        memcpy(set, to, n);
+    }
+
+    for (i = 0; found && i < n; ++i) {
+        /* at the end, or at a $ (the CCL in front of the end) */
+        if (set[i] && (i == cp->end - cp->states ||
+                       ((cp->end->anchor & END) &&
+                        cp->states[i].next == cp->end))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void find_keywords(void)
+{
+    /* A rule is a keyword if it's a plain string that no earlier rule
+     * matches, and the first later rule that matches it has no anchors, is
+     * active in the same start conditions and isn't a plain string itself.
+     * That rule's match of the string is what the keyword's match turns into
+     * when the keyword is left out of the NFA. Rules active in none of the
+     * keyword's conditions don't count. */
+    COMPILER *cp;
+    int i, j;
+
+    for (i = 0; i < Nrules; ++i) {
+        Rules[i].after = -1;
+        literal(&Rules[i]);
+    }
+
+    for (i = 0; i < Nrules && Hash_keywords; ++i) {
+        cp = &Rules[i];
+        if (!cp->literal) {
+            continue;
+        }
+
+        for (j = 0; j < i && !((Rules[j].conds & cp->conds) &&
+                               matches(&Rules[j], cp->literal, cp->len)); ++j) {
+            /* look for a rule that shadows it */
+        }
+        if (j < i) {
+            continue;
+        }
+
+        for (j = i + 1; j < Nrules && !((Rules[j].conds & cp->conds) &&
+                        matches(&Rules[j], cp->literal, cp->len)); ++j) {
+            /* look for the rule it competes with */
+        }
+        if (j < Nrules && !Rules[j].literal &&
+            Rules[j].end->anchor == NONE && Rules[j].conds == cp->conds) {
+            cp->after = j;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Literal rules
+ *---------------------------------------------------------------------------*/
+#define LITERAL_MIN 8       /* literal rules worth an automaton of their own */
+
+static AC *Ac;              /* the literal automaton */
+static char **Lit_accept;   /* accept strings, indexed by value in Ac */
+static int Nliterals;
+
+AC *literals(char ***acceptp)
+{
+    *acceptp = Lit_accept;
+    return Ac;
+}
+
+static int routable(COMPILER *cp)
+{
+    /* True if cp can go in the literal automaton: a plain string that isn't
+     * a keyword, active in every start condition, since the automaton is */
+    return cp->literal && cp->after < 0 && cp->conds == all_conds();
+}
+
+static void find_literals(void)
+{
+    /* If there are enough plain-string rules that aren't keywords, give
+     * them values in a literal automaton, in rule order. */
+    int i;
+
+    if (Ac) {
+        ac_free(Ac);
+        free(Lit_accept);
+        Ac = NULL;
+        Lit_accept = NULL;
+    }
+
+    for (i = Nliterals = 0; i < Nrules; ++i) {
+        Rules[i].lit = -1;
+        Nliterals += routable(&Rules[i]);
+    }
+    if (Nliterals < LITERAL_MIN || !Ac_literals) {
+        Nliterals = 0;
+        return;
+    }
+
+    Ac = ac_new();
+    Lit_accept = (char **) malloc(Nliterals * sizeof(char *));
+    if (Lit_accept == NULL) {
+        ferr("Not enough memeory for NFA\n");
+    }
+
+    for (i = Nliterals = 0; i < Nrules; ++i) {
+        if (routable(&Rules[i])) {
+            Rules[i].lit = Nliterals++;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * The whole machine
+ *---------------------------------------------------------------------------*/
+static nfa_state **Starts;  /* start states, see start_states() */
+static int Nstarts;
+
+int start_states(nfa_state ***tabp)
+{
+    /* The start states of the machine thompson() made, indexed by start
+     * condition * 2, plus 1 at the start of a line. Some may be the same. */
+    *tabp = Starts;
+    return Nstarts;
+}
+
+static int in_start(COMPILER *cp, int s)
+{
+    /* True if the rule is in the machine of start state s */
+    return cp->after < 0 && cp->lit < 0 && (cp->conds >> (s / 2) & 1) &&
+           (!(cp->end->anchor & START) || (s & 1));
+}
+
+static int same_start(int s, int t)
+{
+    /* True if start states s and t have the same rules */
+    int i;
+
+    for (i = 0; i < Nrules; ++i) {
+        if (in_start(&Rules[i], s) != in_start(&Rules[i], t)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+nfa_state *thompson(char *(*input_func)(), int *max_state, 
+                    nfa_state **start_state)
+{
+    /* Read the rules with input_func() and make one NFA of them. Return the
+     * state array, the number of states in it in *max_state and the start
+     * state of INITIAL in mid-line in *start_state; start_states() has the
+     * rest. The rules are compiled on Threads threads. Each rule's states
+     * come after those of the rules before it, which keeps the accepting
+     * states in rule order, so earlier rules still win. */
+    int nthreads = Threads > 1 ? Threads : 1, size = 0, i, s, t, n;
+    pthread_t *threads;
+    nfa_state *p, *base, **link;
+    COMPILER *cp;
+    KEYWORD *kw;
+    char *line;
+
+    /* Read the rules, skipping blank lines */
+    while ((line = input_func()) != NULL) {
+        while (isspace(*line)) {
+            ++line;
+        }
+        if (*line == '\0') {
+            continue;
+        }
+
+        if (Nrules % 64 == 0) {
+            Rules = realloc(Rules, (Nrules + 64) * sizeof(COMPILER));
+            if (Rules == NULL) {
+                ferr("Not enough memeory for NFA\n");
+            }
+        }
+
+        cp = &Rules[Nrules++];
+        memset(cp, 0, sizeof(COMPILER));
+        cp->lineno = Lineno;
+        cp->actual_lineno = Actual_lineno;
+        line = start_conds(cp, line);
+        if ((cp->rule = strdup(line)) == NULL) {
+            parse_err(cp, E_MEM);
+        }
+    }
+
+    /* Compile them */
+    Next_rule = 0;
+    threads = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+    for (i = 1; i < nthreads; ++i) {
+        if (pthread_create(&threads[i], NULL, compile_rules, NULL) != 0) {
+            nthreads = i;   /* the threads there are will do */
+            break;
+        }
+    }
+    compile_rules(NULL);
+    for (i = 1; i < nthreads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    find_keywords();
+    find_literals();
+    Keywords = (KEYWORD *) realloc(Keywords, (Nrules + 1) * sizeof(KEYWORD));
+    Nkeywords = 0;
+    if (Keywords == NULL) {
+        ferr("Not enough memeory for NFA\n");
+    }
+
+    /* A new string pool, with room for every action and for an empty string
+     * after them, for a last rule with a "|" action. The last pool's strings
+     * are still in the tables made from it. */
+    for (i = 0, n = 2; i < Nrules; ++i) {
+        n += save_size(Rules[i].action);
+    }
+    if ((Savep = Strings = (int *) calloc(n, sizeof(int))) == NULL) {
+        ferr("Not enough memeory for NFA\n");
+    }
+
+    /* machine --> rule machine | rule END_OF_INPUT, once for each start
+     * state: a chain of OR states, each one's next going to a rule and its
+     * next2 to the next OR. A ^ rule is entered past its \n, and only from
+     * the start-of-line states. The chains come after all of the rules, and
+     * start states with the same rules share one. */
+    Nstarts = 2 * Nconds;
+    Starts = (nfa_state **) realloc(Starts, Nstarts * sizeof(nfa_state *));
+    if (Starts == NULL) {
+        ferr("Not enough memeory for NFA\n");
+    }
+
+    for (i = 0; i < Nrules; ++i) {
+        if (Rules[i].after < 0 && Rules[i].lit < 0) {
+            size += Rules[i].next_alloc;
+        }
+    }
+    for (s = 0; s < Nstarts; ++s) {
+        for (t = 0; t < s && !same_start(s, t); ++t) {
+            /* look for one like it */
+        }
+        if (t == s) {
+            for (i = n = 0; i < Nrules; ++i) {
+                n += in_start(&Rules[i], s);
+            }
+            size += n ? n : 1;
+        }
+    }
+
+    Nfa_states = (nfa_state *) calloc(size, sizeof(nfa_state));
+    if (Nfa_states == NULL) {
+        ferr("Not enough memeory for NFA\n");
+    }
+
+    Nstates = 0;
+    for (i = 0, base = Nfa_states; i < Nrules; ++i) {
+        cp = &Rules[i];
+        Lineno = cp->lineno;
+
+        if (cp->after >= 0) {
+            /* a keyword, it goes in the hash table instead */
+            kw = &Keywords[Nkeywords++];
+            kw->text = cp->literal;
+            kw->len = cp->len;
+            kw->accept = save(cp->action);
+            nfa_free(cp->states, cp->next_alloc);
+            free(cp->rule);
+            continue;
+        }
+
+        if (cp->lit >= 0) {
+            /* a plain string, it goes in the literal automaton instead */
+            Lit_accept[cp->lit] = save(cp->action);
+            ac_add(Ac, cp->literal, cp->len, cp->lit);
+            nfa_free(cp->states, cp->next_alloc);
+            free(cp->literal);
+            free(cp->rule);
+            continue;
+        }
+
+        move_states(cp, base);
+        cp->end->accept = save(cp->action);
+
+        Nstates += cp->nstates;
+        base += cp->next_alloc;
+        free(cp->literal);
+        free(cp->rule);
+    }
+
+    for (s = 0; s < Nstarts; ++s) {
+        for (t = 0; t < s && !same_start(s, t); ++t) {
+            /* look for one like it */
+        }
+        if (t < s) {
+            Starts[s] = Starts[t];
+            continue;
+        }
+
+        link = &Starts[s];
+        *link = NULL;
+        for (i = 0; i < Nrules; ++i) {
+            cp = &Rules[i];
+            if (in_start(cp, s)) {
+                *link = p = base++;
+                p->edge = EPSILON;
+                p->next = (cp->end->anchor & START) ? cp->start->next
+                                                    : cp->start;
+                link = &p->next2;
+                ++Nstates;
+                mem_add(MEM_NFA, sizeof(nfa_state), 1);
+            }
+        }
+        if (Starts[s] == NULL) {
+            /* no rules, a start state that goes nowhere */
+            Starts[s] = base++;
+            Starts[s]->edge = EPSILON;
+            ++Nstates;
+            mem_add(MEM_NFA, sizeof(nfa_state), 1);
+        }
+    }
+
+    for (i = 0, kw = Keywords; i < Nrules; ++i) {
+        if (Rules[i].after >= 0) {
+            (kw++)->after = Rules[Rules[i].after].end->accept;
+        }
+    }
+    kw_build(Keywords, Nkeywords);
+    if (Ac) {
+        ac_build(Ac);
+    }
+
+    *start_state = Starts[0];
+    *max_state = size;
+
+    if (Verbose > 1) {
+        print_nfa(Nfa_states, *max_state, *start_state);
+    }
+
+    if (Verbose) {
+        printf("%d NFA states used in %d rules (at most %d a rule).\n",
+               *max_state, Nrules, NFA_MAX);
+        printf("%d bytes used for accept strings.\n",
+               (int)((Savep - Strings) * sizeof(int)));
+        printf("%d keyword rules looked up in a perfect hash.\n", Nkeywords);
+        printf("%d literal rules in an automaton of %d states.\n",
+               Nliterals, Ac ? ac_states(Ac) : 0);
+        printf("%d start states for %d start conditions.\n\n",
+               Nstarts, Nconds);
+    }
+
+    free(Rules);
+    Rules = NULL;
+    Nrules = 0;
+    return Nfa_states;
+}
+
+/*-----------------------------------------------------------------------------
+ * A single regular expression, for rx.c
+ *---------------------------------------------------------------------------*/
+nfa_state *nfa_compile(const char *pattern, int *max_state,
+                       nfa_state **start_state, nfa_state **end_state,
+                       const char **errmsg)
+{
+    /* Compile "pattern", which has no action, into a machine of its own.
+     * Macros defined with new_macro() may be used. Return the state array,
+     * to be freed with nfa_free(), the number of states in *max_state, and
+     * the start and accepting states; the anchor is in (*end_state)->anchor
+     * and the trailing context in (*end_state)->trail.
+     * If the pattern is malformed, return NULL and point *errmsg (if it isn't
+     * NULL) at the reason. May be called by several threads at once. */
+    COMPILER *cp;
+    jmp_buf env;
+    nfa_state *nfa = NULL;
+    char *p;
+
+    if ((cp = (COMPILER *) calloc(1, sizeof(COMPILER))) == NULL ||
+        (cp->rule = strdup(pattern)) == NULL) {
+        if (errmsg) {
+            *errmsg = Errmsgs[E_MEM];
+        }
+        free(cp);
+        return NULL;
+    }
+    cp->on_error = &env;
+
+    if (setjmp(env) == 0) {
+        for (p = cp->rule; isspace(*p); ++p) {
+            /* pass */
+        }
+        if (*p == '\0') {
+            parse_err(cp, E_BADEXPR);
+        }
+
+        compile(cp);
+        if (*cp->action) {
+            parse_err(cp, E_BADEXPR);   /* more after a space */
+        }
+
+        if ((nfa = (nfa_state *) malloc(cp->next_alloc *
+                                        sizeof(nfa_state))) == NULL) {
+            parse_err(cp, E_MEM);
+        }
+        move_states(cp, nfa);
+        cp->end->accept = "";
+        *max_state = cp->next_alloc;
+        *start_state = cp->start;
+        *end_state = cp->end;
+    } else {
+        /* Everything made so far is in a state, but for a UTF-8 class
+         * that was being read */
+        nfa = NULL;
+        if (cp->states) {
+            nfa_free(cp->states, cp->next_alloc);
+        }
+        if (cp->set) {
+            delset(cp->set);
+            mem_add(MEM_CCL, -(long)sizeof(SET), -1);
+        }
+        free(cp->ranges);
+        if (errmsg) {
+            *errmsg = Errmsgs[cp->error];
+        }
+    }
+
+    free(cp->rule);
+    free(cp);
+    return nfa;
+}
+
+void nfa_free(nfa_state *nfa, int nstates)
+{
+    /* Free a machine made by nfa_compile() */
+    int i;
+
+    for (i = 0; i < nstates; ++i) {
+        if (nfa[i].edge == CCL && nfa[i].bitset) {
+            delset(nfa[i].bitset);
+            mem_add(MEM_CCL, -(long)sizeof(SET), -1);
+        }
+        if (nfa[i].edge != EMPTY) {
+            mem_add(MEM_NFA, -(long)sizeof(nfa_state), -1);
+        }
+    }
+    free(nfa);
 }
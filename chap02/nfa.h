@@ -12,6 +12,9 @@ typedef struct _nfa_state{
     char *accept;   /* NULL if not an accepting state, else a pointer to the
                        action string */
     int anchor; /* Says whether pattern is anchored and, if so where */
+    int trail;  /* In an accepting state, the characters of trailing context
+                   (r/s or r$) to push back after a match or, if negative,
+                   minus the length of the lexeme. See TRAIL. */
 } nfa_state;
 
 typedef enum {
@@ -26,20 +29,33 @@ typedef enum {
     START = 1,               /* Anchored at start of line */
     END   = 2,               /* Anchored at end of line */
     BOTH  = (START | END),   /* Anchored in both places */
+    TRAIL = 4,               /* Has trailing context, r/s */
 } anchor_type;
 
+/* A rule r/s matches r only when s follows it, and s is left in the input.
+ * The machine matches r and s together, so the DFA knows where the lexeme
+ * ends only from the accepting state's trail: s has a fixed length (and
+ * that many characters are pushed back) or r has (and the lexeme is that
+ * long). A rule where neither does is an error. A trailing $ is a newline of
+ * trailing context. */
+
 /* Other Definitions and Prototypes */
-const int NFA_MAX = 768;    /* Maximum number of NFA states in a single
+#define NFA_MAX 768         /* Maximum number of NFA states in a single
                                machine.  NFA_MAX * sizeof(NFA) cannot exceed
                                64K. */
-const int STR_MAX = (10 * 1024);    /* Total space that can be used by the
-                                       accept strings. */
 
-/* these three are in nfa.c */
+/* these are in nfa.c */
 void new_macro(char *definition);
+void new_condition(char *name, int exclusive);
+int conditions(char ***namesp);
+int start_states(nfa_state ***tabp);
 void print_macros(void);
 nfa_state *thompson(char *(*input_func)(), int *max_state, 
                     nfa_state **start_state);
+nfa_state *nfa_compile(const char *pattern, int *max_state,
+                       nfa_state **start_state, nfa_state **end_state,
+                       const char **errmsg);
+void nfa_free(nfa_state *nfa, int nstates);
 
 /* in printnfa.c */
 void print_nfa(nfa_state *nfa, int len, nfa_state *start);
@@ -0,0 +1,97 @@
+/* printnfa.c -- print an NFA made by thompson() or nfa_compile() */
+
+#include <stdio.h>
+
+#include "tools/set.h"
+
+#include "nfa.h"
+
+static void printccl(SET *set)
+{
+    /* Print a character class, ranges of three or more as a-b */
+    int c, hi;
+
+    putchar('[');
+    if (set->compl) {
+        putchar('^');
+    }
+    for (c = 0; c < _SET_MAX; ++c) {
+        if (!MEMBER(set, c)) {
+            continue;
+        }
+        for (hi = c; hi + 1 < _SET_MAX && MEMBER(set, hi + 1); ++hi) {
+            /* find the end of the range */
+        }
+        printf(c < ' ' || c > '~' ? "\\x%02x" : "%c", c);
+        if (hi - c >= 2) {
+            printf(hi < ' ' || hi > '~' ? "-\\x%02x" : "-%c", hi);
+            c = hi;
+        }
+    }
+    putchar(']');
+}
+
+static char *plab(nfa_state *nfa, nfa_state *state)
+{
+    /* Return a pointer to a buffer containing the state number. The buffer
+     * is overwritten on each call so don't put more than one plab() call in
+     * an argument to printf(). */
+    static char buf[32];
+
+    if (!nfa || !state) {
+        return "--";
+    }
+    sprintf(buf, "%2d", (int)(state - nfa));
+    return buf;
+}
+
+void print_nfa(nfa_state *nfa, int len, nfa_state *start)
+{
+    /* Print the first "len" states of the NFA at "nfa", whose start state is
+     * "start" */
+    nfa_state *s = nfa;
+
+    printf("\n----------------- NFA ---------------\n");
+
+    for (; --len >= 0; nfa++) {
+        if (nfa->edge == EMPTY) {
+            continue;   /* discarded */
+        }
+
+        printf("NFA state %s: ", plab(s, nfa));
+
+        if (!nfa->next) {
+            printf("(TERMINAL)");
+        } else {
+            printf("--> %s ", plab(s, nfa->next));
+            printf("(%s) on ", plab(s, nfa->next2));
+
+            switch (nfa->edge) {
+                case CCL:
+                    printccl(nfa->bitset);
+                    break;
+                case EPSILON:
+                    printf("EPSILON ");
+                    break;
+                default:
+                    printf(nfa->edge < ' ' || nfa->edge > '~' ? "\\x%02x"
+                                                              : "%c",
+                           nfa->edge);
+                    break;
+            }
+        }
+
+        if (nfa == start) {
+            printf(" (START STATE)");
+        }
+        if (nfa->accept) {
+            printf(" accepting %s<%s>%s", nfa->anchor & START ? "^" : "",
+                   nfa->accept, nfa->anchor & END ? "$" : "");
+            if (nfa->anchor & TRAIL) {
+                printf(" trail %d", nfa->trail);
+            }
+        }
+        printf("\n");
+    }
+    printf("\n-------------------------------------\n");
+}
@@ -0,0 +1,847 @@
+/* rx.c -- compile and match regular expressions at run time, see rx.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "tools/set.h"
+#include "compiler.h"
+
+#include "nfa.h"
+#include "dfa.h"
+#include "globals.h"
+#include "memstat.h"
+#include "rx.h"
+
+/*-----------------------------------------------------------------------------
+ * The matcher is chosen by the number of NFA states. A small NFA gets the
+ * whole DFA, made by make_dtran(). A bigger one gets a lazy DFA: its states
+ * are made the first time a match needs them, and there are at most
+ * LAZY_STATES of them; a match that needs more carries on by simulating the
+ * NFA. The biggest are only simulated.
+ *---------------------------------------------------------------------------*/
+#define RX_DFA_MAX  64      /* NFA states: up to this many, make the DFA   */
+#define RX_LAZY_MAX 512     /* up to this many, make it as it's needed     */
+#define LAZY_STATES 1024    /* most DFA states a lazy DFA is allowed       */
+#define LBUCKETS    256     /* hash-table size for them, a power of 2      */
+
+#define CACHE_SIZE  64      /* patterns cached unless rx_cache_size() says */
+#define CBUCKETS    256     /* cache hash-table size, a power of 2         */
+
+#define PREFIX_MAX  64      /* longest literal prefix looked for           */
+
+#define UNKNOWN -2          /* lazy-DFA transition not made yet            */
+#define NOROOM  -3          /* and can't be, there are LAZY_STATES already */
+
+typedef enum { RX_DFA, RX_LAZY, RX_NFA } engine_t;
+
+static char *Engines[] = /* Indexed by engine_t */
+{
+    "dfa",
+    "lazy dfa",
+    "nfa",
+};
+
+/* Sets of NFA states are bit vectors, as in dfa.c */
+typedef uint64_t word_t;
+
+#define WBITS 64
+#define MEM(s, i)   ((s)[(i) / WBITS] & ((word_t)1 << ((i) % WBITS)))
+#define INSERT(s, i) ((s)[(i) / WBITS] |= ((word_t)1 << ((i) % WBITS)))
+
+typedef struct _lstate {
+    word_t *set;            /* NFA states in this DFA state            */
+    unsigned hash;
+    int num;                /* its number                              */
+    bool accept;
+    int next[MAX_CHARS];    /* next state on each character, F or UNKNOWN */
+    struct _lstate *link;   /* next in hash chain                      */
+} LSTATE;
+
+struct rx {
+    char *pattern;
+    unsigned hash;
+    int refs;               /* the cache's and the callers', under Lock */
+    struct rx *link;        /* next in the cache's hash chain           */
+    struct rx *newer;       /* the cache's LRU list                     */
+    struct rx *older;
+
+    nfa_state *nfa;         /* from nfa_compile()                       */
+    int nstates;
+    int nwords;             /* words in a set of NFA states             */
+    nfa_state *start;       /* past the ^ if the pattern has one        */
+    int end;                /* the accepting state                      */
+    int anchor;
+    int trail;              /* trailing context, see nfa.h              */
+    word_t *start_set;      /* e-closure of start                       */
+    bool nullable;          /* can match an empty string                */
+    unsigned char first[256];   /* characters a match can start with    */
+    unsigned char firsts[3];    /* them, if there are no more than 3    */
+    int nfirst;             /* how many there are                       */
+    unsigned char prefix[PREFIX_MAX];   /* every match starts with this */
+    int plen;
+    int rare1, rare2;       /* offsets of its two least common bytes    */
+    engine_t engine;
+
+    ROW *dtran;             /* RX_DFA: from make_dtran()                */
+    ACCEPT *accept;
+    int ndfa;
+
+    LSTATE **lazy;          /* RX_LAZY: states by number, 0 is start    */
+    int nlazy;
+    LSTATE *lbuckets[LBUCKETS];
+    pthread_mutex_t lock;   /* held while making lazy states            */
+};
+
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;   /* the cache */
+static pthread_mutex_t Dtran_lock = PTHREAD_MUTEX_INITIALIZER;
+static rx_t *Cache[CBUCKETS];
+static rx_t *Newest, *Oldest;
+static int Cache_max = CACHE_SIZE;
+static rx_stats_t Stats;
+
+/*-----------------------------------------------------------------------------
+ * NFA simulation
+ *---------------------------------------------------------------------------*/
+static void e_closure(rx_t *rx, word_t *set, int *stack)
+{
+    /* Add to "set" every NFA state that can be reached from it on epsilon
+     * edges. "stack" has room for every state. */
+    int *sp = stack, i, w;
+    word_t bits;
+    nfa_state *p;
+
+    for (w = 0; w < rx->nwords; ++w) {
+        for (bits = set[w]; bits; bits &= bits - 1) {
+            *sp++ = w * WBITS + __builtin_ctzll(bits);
+        }
+    }
+
+    while (sp > stack) {
+        p = &rx->nfa[*--sp];
+        if (p->edge != EPSILON) {
+            continue;
+        }
+        if (p->next && !MEM(set, p->next - rx->nfa)) {
+            i = p->next - rx->nfa;
+            INSERT(set, i);
+            *sp++ = i;
+        }
+        if (p->next2 && !MEM(set, p->next2 - rx->nfa)) {
+            i = p->next2 - rx->nfa;
+            INSERT(set, i);
+            *sp++ = i;
+        }
+    }
+}
+
+static bool move(rx_t *rx, word_t *from, int c, word_t *to)
+{
+    /* Put into "to" the NFA states reached from "from" on a c. Return false
+     * if there aren't any. */
+    bool found = false;
+    word_t bits;
+    nfa_state *p;
+    int w;
+
+    memset(to, 0, rx->nwords * sizeof(word_t));
+    for (w = 0; w < rx->nwords; ++w) {
+        for (bits = from[w]; bits; bits &= bits - 1) {
+            p = &rx->nfa[w * WBITS + __builtin_ctzll(bits)];
+            if (p->next && (p->edge == c ||
+                            (p->edge == CCL && TEST(p->bitset, c)))) {
+                INSERT(to, p->next - rx->nfa);
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+static long length(rx_t *rx, size_t i, size_t j)
+{
+    /* The length of a match from i that reached the accepting state at j.
+     * Trailing context (s in r/s, or the newline before j that matched a $)
+     * isn't part of the match: it's the last "trail" characters or, if
+     * trail is negative, everything after the first -trail. */
+    return (rx->trail >= 0) ? (long)(j - i) - rx->trail : -rx->trail;
+}
+
+static long nfa_run(rx_t *rx, word_t *set, const unsigned char *buf,
+                    size_t i, size_t j, size_t len, long last)
+{
+    /* Carry on with a match that started at buf[i] and has got to buf[j] in
+     * the NFA states "set", by simulating the NFA. "last" is the length of
+     * the longest match so far. */
+    word_t a[rx->nwords], b[rx->nwords], *cur = a, *next = b, *t;
+    int stack[rx->nstates];
+
+    memcpy(cur, set, rx->nwords * sizeof(word_t));
+    for (;; ++j) {
+        if (MEM(cur, rx->end)) {
+            last = length(rx, i, j);
+        }
+
+        if (j == len) {
+            /* $ matches at the end of the buffer too */
+            if ((rx->anchor & END) && move(rx, cur, '\n', next) &&
+                MEM(next, rx->end)) {
+                last = length(rx, i, len + 1);
+            }
+            break;
+        }
+
+        if (!move(rx, cur, buf[j], next)) {
+            break;
+        }
+        e_closure(rx, next, stack);
+        t = cur;
+        cur = next;
+        next = t;
+    }
+    return last;
+}
+
+/*-----------------------------------------------------------------------------
+ * The lazy DFA. Transitions are read without the lock; a new one is stored
+ * (with release semantics) only once the state it leads to is complete, and
+ * states are never freed or moved until the rx_t is, so a reader that sees
+ * a transition also sees its state.
+ *---------------------------------------------------------------------------*/
+static int lazy_state(rx_t *rx, word_t *set)
+{
+    /* Return the number of the lazy state for "set", making it if there's
+     * none, or NOROOM. Called with rx->lock held. */
+    unsigned h = 2166136261u;
+    LSTATE **bucket, *d;
+    int w, c;
+
+    for (w = 0; w < rx->nwords; ++w) {
+        h = (h ^ (unsigned)set[w] ^ (unsigned)(set[w] >> 32)) * 16777619u;
+    }
+    bucket = &rx->lbuckets[h & (LBUCKETS - 1)];
+
+    for (d = *bucket; d; d = d->link) {
+        if (d->hash == h && !memcmp(d->set, set, rx->nwords *
+                                    sizeof(word_t))) {
+            return d->num;
+        }
+    }
+
+    if (rx->nlazy >= LAZY_STATES ||
+        (d = (LSTATE *) malloc(sizeof(LSTATE))) == NULL) {
+        return NOROOM;
+    }
+    if ((d->set = (word_t *) malloc(rx->nwords * sizeof(word_t))) == NULL) {
+        free(d);
+        return NOROOM;
+    }
+
+    memcpy(d->set, set, rx->nwords * sizeof(word_t));
+    d->hash = h;
+    d->num = rx->nlazy;
+    d->accept = MEM(set, rx->end) != 0;
+    for (c = 0; c < MAX_CHARS; ++c) {
+        d->next[c] = UNKNOWN;
+    }
+    d->link = *bucket;
+    *bucket = d;
+    rx->lazy[rx->nlazy] = d;
+
+    mem_add(MEM_DFA, sizeof(LSTATE) + rx->nwords * sizeof(word_t), 1);
+    return rx->nlazy++;
+}
+
+static int lazy_next(rx_t *rx, int s, int c)
+{
+    /* Where lazy state s goes on a c: a state number, F or NOROOM */
+    LSTATE *d = rx->lazy[s];
+    int n = __atomic_load_n(&d->next[c], __ATOMIC_ACQUIRE);
+    word_t set[rx->nwords];
+    int stack[rx->nstates];
+
+    if (n != UNKNOWN) {
+        return n;
+    }
+
+    pthread_mutex_lock(&rx->lock);
+    if ((n = d->next[c]) == UNKNOWN) {
+        if (!move(rx, d->set, c, set)) {
+            n = F;
+        } else {
+            e_closure(rx, set, stack);
+            n = lazy_state(rx, set);
+        }
+
+        if (n != NOROOM) {
+            __atomic_store_n(&d->next[c], n, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&rx->lock);
+    return n;
+}
+
+static long lazy_run(rx_t *rx, const unsigned char *buf, size_t i,
+                     size_t len)
+{
+    long last = -1;
+    size_t j;
+    int s = 0, n;
+
+    for (j = i;; ++j) {
+        if (rx->lazy[s]->accept) {
+            last = length(rx, i, j);
+        }
+
+        if (j == len && !(rx->anchor & END)) {
+            break;
+        }
+
+        n = lazy_next(rx, s, j == len ? '\n' : buf[j]);
+        if (n == NOROOM) {
+            /* out of states, finish by simulating the NFA */
+            return nfa_run(rx, rx->lazy[s]->set, buf, i, j, len, last);
+        }
+        if (n == F) {
+            break;
+        }
+        if (j == len) {
+            /* $ at the end of the buffer */
+            if (rx->lazy[n]->accept) {
+                last = length(rx, i, len + 1);
+            }
+            break;
+        }
+        s = n;
+    }
+    return last;
+}
+
+/*-----------------------------------------------------------------------------
+ * The whole DFA
+ *---------------------------------------------------------------------------*/
+static long dfa_run(rx_t *rx, const unsigned char *buf, size_t i, size_t len)
+{
+    long last = -1;
+    size_t j;
+    int s = 0, n;
+
+    for (j = i;; ++j) {
+        if (rx->accept[s].string) {
+            last = length(rx, i, j);
+        }
+
+        if (j == len) {
+            /* $ matches at the end of the buffer too */
+            if ((rx->anchor & END) && (n = rx->dtran[s]['\n']) != F &&
+                rx->accept[n].string) {
+                last = length(rx, i, len + 1);
+            }
+            break;
+        }
+
+        if ((n = rx->dtran[s][buf[j]]) == F) {
+            break;
+        }
+        s = n;
+    }
+    return last;
+}
+
+static long run(rx_t *rx, const unsigned char *buf, size_t i, size_t len)
+{
+    /* The longest match starting at buf[i], or -1 */
+    switch (rx->engine) {
+        case RX_DFA:
+            return dfa_run(rx, buf, i, len);
+
+        case RX_LAZY:
+            return lazy_run(rx, buf, i, len);
+
+        default:
+            return nfa_run(rx, rx->start_set, buf, i, i, len, -1);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * The prefilter. rx_search() only runs the automaton where a match could
+ * start: where the literal prefix every match starts with (if there's one
+ * at least two characters long) is found, else at one of the characters a
+ * match can start with. The input between is skipped 16 bytes at a time.
+ *---------------------------------------------------------------------------*/
+static int commonness(int c)
+{
+    /* A rough rank of how common c is in text and logs, higher is commoner */
+    return c == ' '                         ? 6 :
+           c && strchr("etaoinshr", c)      ? 5 :
+           islower(c)                       ? 4 :
+           isdigit(c) || (c && strchr(".:-/", c)) ? 3 :
+           isupper(c)                       ? 2 : 1;
+}
+
+static void find_prefix(rx_t *rx)
+{
+    /* Follow the machine from its start for as long as there's just one
+     * character it can go on and it can't have finished a match. Those
+     * characters are the prefix. */
+    word_t set[rx->nwords], to[rx->nwords];
+    int stack[rx->nstates], c, i, w;
+    word_t bits;
+    nfa_state *p;
+
+    memcpy(set, rx->start_set, rx->nwords * sizeof(word_t));
+    for (rx->plen = 0; rx->plen < PREFIX_MAX && !MEM(set, rx->end);) {
+        c = -1;
+        for (w = 0; w < rx->nwords; ++w) {
+            for (bits = set[w]; bits; bits &= bits - 1) {
+                p = &rx->nfa[w * WBITS + __builtin_ctzll(bits)];
+                if (!p->next || p->edge == EPSILON) {
+                    continue;
+                }
+                if (p->edge == CCL || (c >= 0 && p->edge != c)) {
+                    goto done;
+                }
+                c = p->edge;
+            }
+        }
+        if (c < 0 || c >= MAX_CHARS || !move(rx, set, c, to)) {
+            break;
+        }
+        e_closure(rx, to, stack);
+        memcpy(set, to, rx->nwords * sizeof(word_t));
+        rx->prefix[rx->plen++] = c;
+    }
+done:
+    /* The two rarest bytes are the ones scanned for */
+    rx->rare1 = rx->rare2 = 0;
+    for (i = 1; i < rx->plen; ++i) {
+        if (commonness(rx->prefix[i]) < commonness(rx->prefix[rx->rare1])) {
+            rx->rare2 = rx->rare1;
+            rx->rare1 = i;
+        } else if (rx->rare2 == rx->rare1 || commonness(rx->prefix[i]) <
+                   commonness(rx->prefix[rx->rare2])) {
+            rx->rare2 = i;
+        }
+    }
+}
+
+static const unsigned char *scan_prefix(rx_t *rx, const unsigned char *p,
+                                        const unsigned char *end)
+{
+    /* Return the first place at or after p where the prefix is, or NULL */
+    const unsigned char *pre = rx->prefix;
+    int plen = rx->plen, r1 = rx->rare1, r2 = rx->rare2;
+
+#ifdef __SSE2__
+    const __m128i c1 = _mm_set1_epi8(pre[r1]), c2 = _mm_set1_epi8(pre[r2]);
+    unsigned mask;
+
+    for (; end - p >= plen + 15; p += 16) {
+        /* the 16 positions where both rare bytes are in place */
+        mask = _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + r1)), c1),
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + r2)), c2)));
+        for (; mask; mask &= mask - 1) {
+            if (!memcmp(p + __builtin_ctz(mask), pre, plen)) {
+                return p + __builtin_ctz(mask);
+            }
+        }
+    }
+#endif
+
+    for (; end - p >= plen; ++p) {
+        if (p[r1] == pre[r1] && p[r2] == pre[r2] && !memcmp(p, pre, plen)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static const unsigned char *scan_first(rx_t *rx, const unsigned char *p,
+                                       const unsigned char *end)
+{
+    /* Return the first place at or after p with a character that can start
+     * a match, or NULL */
+    if (rx->nfirst == 0) {
+        return NULL;
+    }
+    if (rx->nfirst == 1) {
+        return memchr(p, rx->firsts[0], end - p);
+    }
+
+#ifdef __SSE2__
+    if (rx->nfirst <= 3) {
+        const __m128i c0 = _mm_set1_epi8(rx->firsts[0]);
+        const __m128i c1 = _mm_set1_epi8(rx->firsts[1]);
+        const __m128i c2 = _mm_set1_epi8(rx->firsts[rx->nfirst - 1]);
+        __m128i v;
+        unsigned mask;
+
+        for (; end - p >= 16; p += 16) {
+            v = _mm_loadu_si128((const __m128i *)p);
+            mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(
+                _mm_cmpeq_epi8(v, c0), _mm_cmpeq_epi8(v, c1)),
+                _mm_cmpeq_epi8(v, c2)));
+            if (mask) {
+                return p + __builtin_ctz(mask);
+            }
+        }
+    }
+#endif
+
+    for (; p < end; ++p) {
+        if (rx->first[*p]) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * Making and freeing matchers
+ *---------------------------------------------------------------------------*/
+static void free_rx(rx_t *rx)
+{
+    LSTATE *d, *link;
+    int i;
+
+    if (rx->dtran) {
+        mem_add(MEM_DFA, -(long)(rx->ndfa * sizeof(ROW)), 0);
+        free(rx->dtran);
+        free(rx->accept);
+    }
+
+    if (rx->lazy) {
+        for (i = 0; i < LBUCKETS; ++i) {
+            for (d = rx->lbuckets[i]; d; d = link) {
+                link = d->link;
+                free(d->set);
+                free(d);
+                mem_add(MEM_DFA, -(long)(sizeof(LSTATE) + rx->nwords *
+                                         sizeof(word_t)), -1);
+            }
+        }
+        free(rx->lazy);
+        pthread_mutex_destroy(&rx->lock);
+    }
+
+    if (rx->nfa) {
+        nfa_free(rx->nfa, rx->nstates);
+    }
+    free(rx->start_set);
+    free(rx->pattern);
+    free(rx);
+}
+
+static rx_t *new_rx(const char *pattern, unsigned hash, const char **errmsg)
+{
+    nfa_state *start, *end;
+    word_t *set;
+    rx_t *rx;
+    int c, n = 0, dstart;
+
+    if ((rx = (rx_t *) calloc(1, sizeof(rx_t))) == NULL ||
+        (rx->pattern = strdup(pattern)) == NULL) {
+        free(rx);
+        if (errmsg) {
+            *errmsg = "Not enough memory for the pattern";
+        }
+        return NULL;
+    }
+    rx->hash = hash;
+
+    rx->nfa = nfa_compile(pattern, &rx->nstates, &start, &end, errmsg);
+    if (rx->nfa == NULL) {
+        free_rx(rx);
+        return NULL;
+    }
+
+    /* A ^ is a newline edge in front of the rest of the machine. Matches
+     * are only tried at the start of a line, so it's left out. */
+    rx->anchor = end->anchor;
+    rx->trail = end->trail;
+    rx->start = (rx->anchor & START) ? start->next : start;
+    rx->end = end - rx->nfa;
+    rx->nwords = (rx->nstates + WBITS - 1) / WBITS;
+
+    if ((set = rx->start_set = (word_t *) calloc(rx->nwords,
+                                                 sizeof(word_t))) == NULL) {
+        goto nomem;
+    }
+    {
+        word_t to[rx->nwords];
+        int stack[rx->nstates];
+
+        INSERT(set, rx->start - rx->nfa);
+        e_closure(rx, set, stack);
+
+        /* The characters a match can start with, and whether it can be empty
+         * (a $ alone is empty at the end of the buffer) */
+        rx->nullable = MEM(set, rx->end) || ((rx->anchor & END) &&
+                        move(rx, set, '\n', to) && MEM(to, rx->end));
+        for (c = 0; c < MAX_CHARS; ++c) {
+            if ((rx->first[c] = move(rx, set, c, to)) && n++ < 3) {
+                rx->firsts[n - 1] = c;
+            }
+        }
+        rx->nfirst = n;
+    }
+    if (!rx->nullable) {
+        find_prefix(rx);
+    }
+
+    if (rx->nstates <= RX_DFA_MAX) {
+        /* make_dtran() isn't reentrant */
+        rx->engine = RX_DFA;
+        pthread_mutex_lock(&Dtran_lock);
+        rx->ndfa = make_dtran(rx->nfa, rx->nstates, &rx->start, 1, &dstart,
+                              &rx->dtran, &rx->accept);
+        pthread_mutex_unlock(&Dtran_lock);
+    } else if (rx->nstates <= RX_LAZY_MAX) {
+        rx->engine = RX_LAZY;
+        if ((rx->lazy = (LSTATE **) calloc(LAZY_STATES,
+                                           sizeof(LSTATE *))) == NULL) {
+            goto nomem;
+        }
+        pthread_mutex_init(&rx->lock, NULL);
+        if (lazy_state(rx, set) != 0) {
+            goto nomem;
+        }
+    } else {
+        rx->engine = RX_NFA;
+    }
+    return rx;
+
+nomem:
+    if (errmsg) {
+        *errmsg = "Not enough memory for the pattern";
+    }
+    free_rx(rx);
+    return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ * The cache. Lock protects the table, the LRU list, the reference counts
+ * and Stats. Patterns are compiled without it.
+ *---------------------------------------------------------------------------*/
+static unsigned hash_pattern(const char *p)
+{
+    unsigned h = 2166136261u;
+
+    while (*p) {
+        h = (h ^ (unsigned char)*p++) * 16777619u;
+    }
+    return h;
+}
+
+static rx_t *lookup(const char *pattern, unsigned hash)
+{
+    rx_t *rx;
+
+    for (rx = Cache[hash & (CBUCKETS - 1)]; rx; rx = rx->link) {
+        if (rx->hash == hash && !strcmp(rx->pattern, pattern)) {
+            return rx;
+        }
+    }
+    return NULL;
+}
+
+static void unlink_lru(rx_t *rx)
+{
+    *(rx->newer ? &rx->newer->older : &Newest) = rx->older;
+    *(rx->older ? &rx->older->newer : &Oldest) = rx->newer;
+}
+
+static void make_newest(rx_t *rx)
+{
+    rx->newer = NULL;
+    rx->older = Newest;
+    *(Newest ? &Newest->newer : &Oldest) = rx;
+    Newest = rx;
+}
+
+static rx_t *evict(void)
+{
+    /* Drop the oldest pattern from the cache. Return it if that was its
+     * last reference, for the caller to free once Lock is released. */
+    rx_t *rx = Oldest, **pp = &Cache[rx->hash & (CBUCKETS - 1)];
+
+    while (*pp != rx) {
+        pp = &(*pp)->link;
+    }
+    *pp = rx->link;
+    unlink_lru(rx);
+    --Stats.cached;
+    ++Stats.evictions;
+    return --rx->refs == 0 ? rx : NULL;
+}
+
+static void trim(void)
+{
+    /* Evict until the cache fits, called with Lock held */
+    rx_t *dead = NULL, *rx;
+
+    while (Stats.cached > Cache_max) {
+        if ((rx = evict()) != NULL) {
+            rx->link = dead;
+            dead = rx;
+        }
+    }
+
+    pthread_mutex_unlock(&Lock);
+    for (; dead; dead = rx) {
+        rx = dead->link;
+        free_rx(dead);
+    }
+}
+
+rx_t *rx_compile(const char *pattern, const char **errmsg)
+{
+    unsigned hash = hash_pattern(pattern);
+    rx_t *rx, *found;
+
+    pthread_mutex_lock(&Lock);
+    if ((rx = lookup(pattern, hash)) != NULL) {
+        ++Stats.hits;
+        ++rx->refs;
+        unlink_lru(rx);
+        make_newest(rx);
+        pthread_mutex_unlock(&Lock);
+        return rx;
+    }
+    ++Stats.misses;
+    pthread_mutex_unlock(&Lock);
+
+    if ((rx = new_rx(pattern, hash, errmsg)) == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&Lock);
+    if ((found = lookup(pattern, hash)) != NULL) {
+        /* another thread compiled it meanwhile */
+        ++found->refs;
+        pthread_mutex_unlock(&Lock);
+        free_rx(rx);
+        return found;
+    }
+
+    rx->refs = 1;
+    if (Cache_max > 0) {
+        ++rx->refs;
+        rx->link = Cache[hash & (CBUCKETS - 1)];
+        Cache[hash & (CBUCKETS - 1)] = rx;
+        make_newest(rx);
+        ++Stats.cached;
+    }
+    trim();     /* releases Lock */
+    return rx;
+}
+
+void rx_release(rx_t *rx)
+{
+    bool dead;
+
+    pthread_mutex_lock(&Lock);
+    dead = (--rx->refs == 0);
+    pthread_mutex_unlock(&Lock);
+
+    if (dead) {
+        free_rx(rx);
+    }
+}
+
+void rx_cache_size(int n)
+{
+    pthread_mutex_lock(&Lock);
+    Cache_max = n > 0 ? n : 0;
+    trim();     /* releases Lock */
+}
+
+const rx_stats_t *rx_stats(void)
+{
+    return &Stats;
+}
+
+/*-----------------------------------------------------------------------------
+ * Matching
+ *---------------------------------------------------------------------------*/
+long rx_match(rx_t *rx, const char *buf, size_t len)
+{
+    return run(rx, (const unsigned char *)buf, 0, len);
+}
+
+long rx_search(rx_t *rx, const char *buf, size_t len, size_t *startp)
+{
+    const unsigned char *p = (const unsigned char *)buf, *q;
+    size_t i = 0;
+    long n;
+
+    while (i <= len) {
+        if ((rx->anchor & START) && i > 0 && p[i - 1] != '\n') {
+            /* a ^ only matches at the start of a line */
+            if ((q = memchr(p + i, '\n', len - i)) == NULL) {
+                break;
+            }
+            i = q - p + 1;
+            continue;
+        }
+
+        if (!rx->nullable) {
+            /* skip what can't start a match */
+            q = rx->plen > 1 ? scan_prefix(rx, p + i, p + len)
+                             : scan_first(rx, p + i, p + len);
+            if (q == NULL) {
+                break;
+            }
+            if (q > p + i) {
+                i = q - p;
+                continue;   /* check for ^ again */
+            }
+        }
+
+        if ((n = run(rx, p, i, len)) >= 0) {
+            *startp = i;
+            return n;
+        }
+        ++i;
+    }
+    return -1;
+}
+
+const char *rx_engine(const rx_t *rx)
+{
+    return Engines[rx->engine];
+}
+
+long rx_grep(rx_t *rx, const char *buf, size_t len,
+             void (*line)(const char *text, size_t len, void *arg), void *arg)
+{
+    /* Call line() for each line of buf with a match in it, without its
+     * newline, and return how many there were. */
+    const char *start, *end, *p = buf, *stop = buf + len;
+    size_t at;
+    long n = 0;
+
+    while (p < stop && rx_search(rx, p, stop - p, &at) >= 0) {
+        for (start = p + at; start > p && start[-1] != '\n'; --start) {
+            /* back to the start of the line */
+        }
+        if ((end = memchr(p + at, '\n', stop - (p + at))) == NULL) {
+            end = stop;
+        }
+
+        ++n;
+        if (line) {
+            line(start, end - start, arg);
+        }
+        p = end + 1;
+    }
+    return n;
+}
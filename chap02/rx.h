@@ -0,0 +1,54 @@
+#ifndef RX_H
+#define RX_H
+
+/* rx.h -- regular expressions at run time, with the same syntax as the rules
+ * of a lex file: whitespace ends a pattern unless it's quoted or escaped (\s),
+ * and macros defined with new_macro() may be used. Each pattern is compiled
+ * with Thompson's construction (nfa.c) and matched by a DFA made up front, a
+ * DFA whose states are made as they're needed, or by simulating the NFA,
+ * depending on its size. Patterns match bytes; with Utf8 set (globals.h),
+ * a class or dot matches UTF-8 characters instead.
+ *
+ * Compiled patterns are kept in a cache shared by all threads, keyed by the
+ * pattern's text, so compiling a pattern that's been seen recently costs a
+ * lookup. The least recently used pattern is dropped when the cache is full.
+ */
+
+#include <stddef.h>
+
+typedef struct rx rx_t;
+
+typedef struct {
+    long hits;          /* rx_compile() calls answered from the cache */
+    long misses;        /* and those that had to compile              */
+    long evictions;     /* patterns dropped to make room              */
+    long cached;        /* patterns in the cache                      */
+} rx_stats_t;
+
+/* Return the matcher for "pattern", or NULL with *errmsg (if errmsg isn't
+ * NULL) pointing at the reason if it's malformed. Hand it back with
+ * rx_release() when done; it may be used by several threads at once. */
+rx_t *rx_compile(const char *pattern, const char **errmsg);
+void rx_release(rx_t *rx);
+
+/* Length of the longest match at the start of buf, or -1 if there's none.
+ * A pattern r/s matches r where s follows it; s is looked at but isn't part
+ * of the match. */
+long rx_match(rx_t *rx, const char *buf, size_t len);
+
+/* Length of the leftmost longest match in buf, whose offset is put in
+ * *startp, or -1 if there's none. ^ matches at the start of buf and after a
+ * newline, $ before a newline and at the end of buf. */
+long rx_search(rx_t *rx, const char *buf, size_t len, size_t *startp);
+
+/* Grep: call line() with each line of buf that has a match in it (without
+ * the newline) and return how many there were. line may be NULL. */
+long rx_grep(rx_t *rx, const char *buf, size_t len,
+             void (*line)(const char *text, size_t len, void *arg), void *arg);
+
+const char *rx_engine(const rx_t *rx);  /* "dfa", "lazy dfa" or "nfa" */
+
+void rx_cache_size(int n);              /* patterns kept, 0: no caching */
+const rx_stats_t *rx_stats(void);
+
+#endif /* end of include guard: RX_H */
@@ -0,0 +1,533 @@
+/* iitest.c -- checks of the input system (input_system/input.h): switching
+ * between files, sources and buffers, empty ones included, lexemes and
+ * lookahead with small buffers that have to grow, line numbers, lookahead
+ * that moves the buffer, and the statistics. Prints the checks that fail;
+ * exits with 1 if any did. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "input.h"
+
+int Verbose = 0;            /* input.c's, see globals.h */
+
+/* A source for ii_newsource() that hands out a string, at most "max" bytes
+ * a read */
+typedef struct {
+    const char *text;
+    size_t pos;
+    size_t max;
+} MEMSRC;
+
+static int Failed = 0;
+static int Closes = 0;      /* MEMSRC close() calls */
+static char Text[8192];     /* words, see make_text() */
+
+static ssize_t mem_read(void *arg, unsigned char *buf, size_t n)
+{
+    MEMSRC *m = arg;
+    size_t left = strlen(m->text) - m->pos;
+
+    if (n > m->max) {
+        n = m->max;
+    }
+    if (n > left) {
+        n = left;
+    }
+    memcpy(buf, m->text + m->pos, n);
+    m->pos += n;
+    return n;
+}
+
+static void mem_close(void *arg)
+{
+    ++Closes;
+}
+
+static void open_file(const char *text)
+{
+    /* ii_newfile() on a temporary file holding text */
+    char name[] = "/tmp/iitestXXXXXX";
+    int fd = mkstemp(name);
+
+    if (fd < 0 || write(fd, text, strlen(text)) != (ssize_t)strlen(text)) {
+        perror("iitest");
+        exit(1);
+    }
+    close(fd);
+    if (ii_newfile(name) < 0) {
+        perror(name);
+        exit(1);
+    }
+    unlink(name);
+}
+
+static void open_source(MEMSRC *m, const char *text, size_t max)
+{
+    ii_source_t src = { mem_read, mem_close, NULL };
+
+    m->text = text;
+    m->pos = 0;
+    m->max = max;
+    src.arg = m;
+    ii_newsource(&src);
+}
+
+static void open_buffer(char *buf, size_t size, const char *text)
+{
+    /* ii_newbuffer() on a copy of text; the byte after it is the spare */
+    if (strlen(text) >= size) {
+        fprintf(stderr, "iitest: %s is too long\n", text);
+        exit(1);
+    }
+    strcpy(buf, text);
+    ii_newbuffer(buf, strlen(text));
+}
+
+static void expect(const char *what, const char *text)
+{
+    /* Read the input to its end: it must be text, and stay at its end */
+    char got[256];
+    int c, n = 0;
+
+    while ((c = ii_advance()) > 0 && n < (int)sizeof(got) - 1) {
+        got[n++] = c;
+    }
+    got[n] = '\0';
+
+    if (c != 0 || strcmp(got, text)) {
+        printf("iitest: %s gave \"%s\" (then %d), not \"%s\"\n",
+               what, got, c, text);
+        ++Failed;
+    } else if ((c = ii_advance()) != 0) {
+        printf("iitest: %s gave %d after its end\n", what, c);
+        ++Failed;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+static void check_switching(void)
+{
+    /* Each kind of input after each other kind, empty or not. A short input
+     * after a longer one mustn't show what's left of the old one in the
+     * buffer. */
+    static struct {
+        int how;            /* f: file, s: source, b: buffer */
+        char *text;
+    } inputs[] = {
+        { 'f', "hello" },   { 'f', "" },        { 's', "abc" },
+        { 's', "" },        { 'b', "xyz" },     { 'b', "" },
+        { 'f', "h" },       { 's', "" },        { 'f', "" },
+        { 's', "q" },       { 'b', "" },        { 'f', "" },
+        { 'b', "long line\nand more" },         { 's', "" },
+        { 'f', "the last" },                    { 0, NULL }
+    };
+    static char buf[64];    /* the input until the next one is opened */
+    char what[64];
+    MEMSRC m;
+    int i, closes;
+
+    for (i = 0; inputs[i].how; ++i) {
+        closes = Closes;
+        switch (inputs[i].how) {
+            case 'f': open_file(inputs[i].text);                break;
+            case 's': open_source(&m, inputs[i].text, 2);       break;
+            default:  open_buffer(buf, sizeof(buf), inputs[i].text); break;
+        }
+        if (i > 0 && Closes != closes + (inputs[i - 1].how == 's')) {
+            printf("iitest: input %d, the source wasn't closed once\n", i);
+            ++Failed;
+        }
+
+        sprintf(what, "input %d (%c \"%s\")", i, inputs[i].how,
+                inputs[i].text);
+        expect(what, inputs[i].text);
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+static void make_text(void)
+{
+    /* Words of 1 to 40 letters, a blank after each and a newline after every
+     * seventh; some are much longer than the small buffers below */
+    char *p = Text;
+    int i, len;
+
+    for (i = 0; p < Text + sizeof(Text) - 64; ++i) {
+        for (len = 1 + (i * 7) % 40; len > 0; --len) {
+            *p++ = 'a' + (i + len) % 26;
+        }
+        *p++ = (i % 7 == 6) ? '\n' : ' ';
+    }
+    *p = '\0';
+}
+
+static int scan_words(const char *what)
+{
+    /* Scan Text from the input as a lexer would, word by word: ii_look(1)
+     * must show each character before ii_advance() reads it, and the word
+     * must be the lexeme between the marks. Return 0 if it went wrong. */
+    const char *p = Text, *word;
+    int c;
+
+    while (*p) {
+        ii_mark_start();
+        for (word = p; *p != ' ' && *p != '\n'; ++p) {
+            if ((c = ii_look(1)) != (unsigned char)*p ||
+                (c = ii_advance()) != (unsigned char)*p) {
+                printf("iitest: %s, %d at offset %d, not '%c'\n",
+                       what, c, (int)(p - Text), *p);
+                ++Failed;
+                return 0;
+            }
+        }
+        ii_mark_end();
+        if (ii_length() != p - word || memcmp(ii_text(), word, p - word)) {
+            printf("iitest: %s, lexeme \"%.*s\" at offset %d, not \"%.*s\"\n",
+                   what, ii_length(), ii_text(), (int)(word - Text),
+                   (int)(p - word), word);
+            ++Failed;
+            return 0;
+        }
+        if ((c = ii_advance()) != *p++) {
+            printf("iitest: %s, %d after offset %d\n", what, c,
+                   (int)(word - Text));
+            ++Failed;
+            return 0;
+        }
+    }
+
+    if ((c = ii_look(1)) != EOF || (c = ii_advance()) != 0) {
+        printf("iitest: %s, %d at the end\n", what, c);
+        ++Failed;
+        return 0;
+    }
+    return 1;
+}
+
+static void check_geometry(void)
+{
+    /* The same text through buffers of several shapes, most too small for
+     * the longest words, so they grow; and a Maxlex limit that stops it */
+    static ii_config_t shapes[] = {
+        { 0, 0, 0, 0 },     /* the defaults */
+        { 0, 4, 2, 0 },
+        { 12, 4, 2, 0 },
+        { 0, 3, 1, 0 },
+        { 40, 8, 4, 0 },
+        { 0, 1, 1, 0 },
+    };
+    ii_config_t bad[] = {
+        { 10, 4, 2, 0 },    /* no room for two reads and the lookahead */
+        { 0, 4, -1, 0 },
+    };
+    ii_config_t limit = { 0, 4, 2, 16 };
+    char what[64];
+    MEMSRC m;
+    long grows;
+    int i, c, n, start;
+
+    make_text();
+    for (i = 0; i < (int)(sizeof(shapes) / sizeof(shapes[0])); ++i) {
+        sprintf(what, "buffer %d/%d/%d", (int)shapes[i].bufsize,
+                (int)shapes[i].readsize, shapes[i].maxlook);
+        if (ii_config(&shapes[i]) < 0) {
+            printf("iitest: %s refused\n", what);
+            ++Failed;
+            continue;
+        }
+        grows = ii_stats()->grows;
+        open_source(&m, Text, (size_t)-1);
+        if (scan_words(what) && i > 0 && ii_stats()->grows == grows) {
+            printf("iitest: %s never grew\n", what);
+            ++Failed;
+        }
+    }
+
+    for (i = 0; i < (int)(sizeof(bad) / sizeof(bad[0])); ++i) {
+        if (ii_config(&bad[i]) == 0) {
+            printf("iitest: buffer %d/%d/%d accepted\n", (int)bad[i].bufsize,
+                   (int)bad[i].readsize, bad[i].maxlook);
+            ++Failed;
+        }
+    }
+
+    /* With a 16-byte Maxlex the buffer stops growing once a lexeme is that
+     * long, so reading stops in a word longer than 16 letters */
+    ii_config(&limit);
+    open_source(&m, Text, (size_t)-1);
+    ii_mark_start();
+    for (n = start = 0; (c = ii_advance()) > 0; ++n) {
+        if (c == ' ' || c == '\n') {
+            ii_mark_start();
+            start = n + 1;
+        }
+    }
+    if (c != -1 || strcspn(Text + start, " \n") <= 16) {
+        printf("iitest: Maxlex 16 stopped with %d at offset %d\n", c, n);
+        ++Failed;
+    }
+
+    ii_config(&shapes[0]);
+}
+
+/*---------------------------------------------------------------------------*/
+static int line_at(const char *p)
+{
+    /* The line number at p in Text */
+    const char *q;
+    int line = 1;
+
+    for (q = Text; q < p; ++q) {
+        line += (*q == '\n');
+    }
+    return line;
+}
+
+static int scan_lines(const char *what)
+{
+    /* Scan Text word by word, the blank or newline after each word going with
+     * it. ii_lineno() must be right after each word, after pushing half of it
+     * back and after reading it again; ii_plineno() must still give the line
+     * after the word before. Return 0 if it went wrong. */
+    const char *p = Text, *word, *prev = NULL;
+    int c, back;
+
+    while (*p) {
+        ii_mark_start();
+        for (word = p; *p != ' ' && *p != '\n'; ++p) {
+            ii_advance();
+        }
+        ii_advance();
+        ++p;
+
+        if (ii_lineno() != line_at(p)) {
+            printf("iitest: %s, line %d after offset %d, not %d\n",
+                   what, ii_lineno(), (int)(p - Text), line_at(p));
+            ++Failed;
+            return 0;
+        }
+        if (prev && ii_plineno() != line_at(prev)) {
+            printf("iitest: %s, previous line %d at offset %d, not %d\n",
+                   what, ii_plineno(), (int)(prev - Text), line_at(prev));
+            ++Failed;
+            return 0;
+        }
+
+        back = (p - word + 1) / 2;
+        ii_pusback(back);
+        if (ii_lineno() != line_at(p - back)) {
+            printf("iitest: %s, line %d after pushing back to offset %d, "
+                   "not %d\n", what, ii_lineno(), (int)(p - back - Text),
+                   line_at(p - back));
+            ++Failed;
+            return 0;
+        }
+        while (--back >= 0) {
+            if ((c = ii_advance()) != (unsigned char)p[-back - 1]) {
+                printf("iitest: %s, read %d again at offset %d\n", what, c,
+                       (int)(p - back - 1 - Text));
+                ++Failed;
+                return 0;
+            }
+        }
+        if (ii_lineno() != line_at(p)) {
+            printf("iitest: %s, line %d at offset %d read again, not %d\n",
+                   what, ii_lineno(), (int)(p - Text), line_at(p));
+            ++Failed;
+            return 0;
+        }
+
+        ii_mark_end();
+        ii_mark_prev();
+        prev = p;
+    }
+    return 1;
+}
+
+static void check_lines(void)
+{
+    /* Line numbers through the default buffer, a small one that refills and
+     * grows all the time, and a buffer of the caller's */
+    static ii_config_t small = { 0, 4, 2, 0 };
+    static char buf[sizeof(Text)];
+    ii_config_t defaults = { 0 };
+    MEMSRC m;
+
+    make_text();
+    open_source(&m, Text, (size_t)-1);
+    scan_lines("default buffer");
+
+    ii_config(&small);
+    open_source(&m, Text, (size_t)-1);
+    scan_lines("buffer 0/4/2");
+    ii_config(&defaults);
+
+    open_buffer(buf, sizeof(buf), Text);
+    scan_lines("ii_newbuffer()");
+}
+
+/*---------------------------------------------------------------------------*/
+static void check_look(void)
+{
+    /* Looking far past Maxlook in a small buffer reads more, which moves
+     * the text (see ii_look()). The lexemes must come along: ii_text() and
+     * ii_ptext() are got again and must have the same text, and reading on
+     * must give what was looked at. */
+    static ii_config_t small = { 0, 4, 2, 0 };
+    ii_config_t defaults = { 0 };
+    char *old;
+    MEMSRC m;
+    int i, c;
+
+    make_text();
+    ii_config(&small);
+    open_source(&m, Text, (size_t)-1);
+
+    ii_mark_start();
+    ii_advance();
+    ii_advance();
+    ii_mark_end();
+    ii_mark_prev();     /* Text[0..2) */
+    ii_mark_start();
+    for (i = 0; i < 3; ++i) {
+        ii_advance();
+    }
+    ii_mark_end();      /* Text[2..5) */
+    old = ii_text();
+
+    for (i = 1; i <= 60; ++i) {
+        if ((c = ii_look(i)) != (unsigned char)Text[4 + i]) {
+            printf("iitest: ii_look(%d) is %d, not '%c'\n", i, c, Text[4 + i]);
+            ++Failed;
+            break;
+        }
+    }
+
+    if (ii_text() == old) {
+        printf("iitest: looking 60 ahead in 16 bytes didn't move the text\n");
+        ++Failed;
+    }
+    if (ii_length() != 3 || memcmp(ii_text(), Text + 2, 3) ||
+        ii_plength() != 2 || memcmp(ii_ptext(), Text, 2)) {
+        printf("iitest: after ii_look(), lexemes \"%.*s\" and \"%.*s\"\n",
+               ii_length(), ii_text(), ii_plength(), ii_ptext());
+        ++Failed;
+    }
+    if (ii_lineno() != line_at(Text + 5)) {
+        printf("iitest: after ii_look(), line %d\n", ii_lineno());
+        ++Failed;
+    }
+    for (i = 5; i < 65; ++i) {
+        if ((c = ii_advance()) != (unsigned char)Text[i]) {
+            printf("iitest: after ii_look(), read %d at offset %d\n", c, i);
+            ++Failed;
+            break;
+        }
+    }
+    ii_config(&defaults);
+}
+
+/*---------------------------------------------------------------------------*/
+static void expect_stats(const char *what, const ii_stats_t *want)
+{
+    const ii_stats_t *s = ii_stats();
+
+    if (memcmp(s, want, sizeof(*s))) {
+        printf("iitest: %s, statistics %ld %ld %ld %ld %ld %ld %ld %ld %ld, "
+               "not %ld %ld %ld %ld %ld %ld %ld %ld %ld\n", what,
+               s->fills, s->bytes_read, s->flushes, s->bytes_moved, s->forced,
+               s->max_lexeme, s->grows, s->pushbacks, s->max_pushback,
+               want->fills, want->bytes_read, want->flushes, want->bytes_moved,
+               want->forced, want->max_lexeme, want->grows, want->pushbacks,
+               want->max_pushback);
+        ++Failed;
+    }
+}
+
+static void check_stats(void)
+{
+    /* The counters for reads whose pattern is known. They count from the
+     * start of the program, so this runs first. */
+    static ii_config_t small = { 0, 4, 2, 0 }, limit = { 0, 4, 2, 4 };
+    static char buf[16];    /* the input until the next one is opened */
+    ii_config_t defaults = { 0 };
+    ii_stats_t want;
+    char x[41];
+    MEMSRC m;
+    int c;
+
+    memset(&want, 0, sizeof(want));
+    memset(x, 'x', 40);
+    x[40] = '\0';
+
+    /* A 16-byte buffer with 4-byte reads and a new lexeme at each character:
+     * the first flush moves nothing and reads 16 bytes. Each later one comes
+     * with 2 bytes left (Maxlook), moves them and reads 12 more, until one
+     * reads nothing. */
+    ii_config(&small);
+    open_source(&m, x, (size_t)-1);
+    ii_mark_start();
+    while (ii_advance() > 0) {
+        ii_mark_start();
+    }
+    want.fills = 3;
+    want.bytes_read = 40;
+    want.flushes = 4;
+    want.bytes_moved = 6;
+    expect_stats("40 bytes in 16", &want);
+
+    /* The same with one lexeme and a 4-byte Maxlex: the first flush after
+     * the start can't move anything or grow, until it's forced. It keeps
+     * the two lookahead bytes. */
+    ii_config(&limit);
+    open_source(&m, x, (size_t)-1);
+    ii_mark_start();
+    while ((c = ii_advance()) > 0) {
+        /* pass */
+    }
+    if (c != -1 || ii_flush(1) != 1) {
+        printf("iitest: Maxlex 4, %d at 14 bytes, or the flush failed\n", c);
+        ++Failed;
+    }
+    want.fills += 2;
+    want.bytes_read += 16 + 12;
+    want.flushes += 2;
+    want.bytes_moved += 2;
+    want.forced = 1;
+    expect_stats("forced flush", &want);
+    ii_config(&defaults);
+
+    /* Lexemes and pushback, in a buffer that's never read or flushed */
+    open_buffer(buf, sizeof(buf), "abcdefgh ij");
+    ii_mark_start();
+    while (ii_advance() != ' ') {
+        /* pass */
+    }
+    ii_mark_end();      /* "abcdefgh " */
+    ii_pusback(3);
+    ii_pusback(5);
+    ii_pusback(5);      /* only 1 left before the start of the lexeme */
+    want.max_lexeme = 9;
+    want.pushbacks = 9;
+    want.max_pushback = 5;
+    expect_stats("pushback", &want);
+}
+
+int main(void)
+{
+    check_stats();
+    check_switching();
+    check_geometry();
+    check_lines();
+    check_look();
+
+    if (Failed) {
+        printf("iitest: %d checks failed\n", Failed);
+        return 1;
+    }
+    printf("iitest: ok\n");
+    return 0;
+}
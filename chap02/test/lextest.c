@@ -0,0 +1,440 @@
+/* lextest.c -- checks of a lex spec turned into a DFA by thompson() and
+ * make_dtran(): longest match and rule order, start conditions, ^ and $,
+ * trailing context, keywords looked up in a perfect hash, literal rules
+ * matched with an automaton, that the tables don't depend on the number of
+ * threads, and a spec bigger than the old fixed limits. Prints the checks that fail; exits with 1 if any did. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/set.h"
+#include "nfa.h"
+#define ALLOC
+#include "globals.h"
+#include "dfa.h"
+#include "keyword.h"
+#include "ac.h"
+
+static char *Spec[] =
+{
+    "if                 IF",
+    "{L}({L}|{D})*      ID",
+    "{D}+/px            PX",
+    "{D}+               NUM",
+    "^#.*               HASH",
+    "[\\s\\t]+          WS",
+    "\\n                NL",
+    "\\\"               QUOTE",
+    "<STR>[^\\\"\\n]+   TEXT",
+    "<STR>\\\"          ENDQ",
+    "<STR>\\n           BADNL",
+    "end$               END",
+    ".                  OTHER",
+    NULL
+};
+
+typedef struct {
+    char *action;
+    char *lexeme;
+} TOKEN;
+
+/* Enough plain strings for literals() to take them out of the DFA. "for"
+ * comes after ID, which wins it; "<" and "." are also OTHER's. */
+static char *Lit_spec[] =
+{
+    "<*>\"+=\"          ADDEQ",
+    "<*>\"-=\"          SUBEQ",
+    "<*>\"==\"          EQ",
+    "<*>\"!=\"          NE",
+    "<*>\"<=\"          LE",
+    "<*>\"<<=\"         SHLEQ",
+    "<*>\"<\"           LT",
+    "<*>\"&&\"          AND",
+    "<*>\"||\"          OR",
+    "<*>[a-z]+          ID",
+    "<*>\"for\"         FOR",
+    "<*>\"...\"         DOTS",
+    "<*>[\\s\\n]+        WS",
+    "<*>.               OTHER",
+    NULL
+};
+
+static char *Lit_input = "a<<=b<=c<d!==e&&f||for....+=-=|&\n";
+
+static char *Input = "if x1 12px 34\n#c #d\n\"ab #\" end\nend.\n";
+
+static TOKEN Tokens[] =
+{
+    { "IF", "if" },     { "WS", " " },      { "ID", "x1" },
+    { "WS", " " },      { "PX", "12" },     { "ID", "px" },
+    { "WS", " " },      { "NUM", "34" },    { "NL", "\n" },
+    { "HASH", "#c #d" },                    { "NL", "\n" },
+    { "QUOTE", "\"" },  { "TEXT", "ab #" },  { "ENDQ", "\"" },
+    { "WS", " " },      { "END", "end" },   { "NL", "\n" },
+    { "ID", "end" },    { "OTHER", "." },   { "NL", "\n" },
+    { NULL, NULL }
+};
+
+/* A machine made by dfa() */
+typedef struct {
+    ROW *dtran;
+    ACCEPT *accept;
+    int nstates;
+    int *starts;
+    int nstarts;
+} MACHINE;
+
+static int Failed = 0;
+static char **Next_line;
+static char Line[256];
+
+static char *get_line(void)
+{
+    /* Input function for thompson(): the lines of the spec */
+    if (*Next_line == NULL) {
+        return NULL;
+    }
+    strcpy(Line, *Next_line++);
+    ++Actual_lineno;
+    Lineno = Actual_lineno;
+    return Line;
+}
+
+static void make(MACHINE *m, char **spec)
+{
+    int *starts;
+
+    Next_line = spec;
+    m->nstates = dfa(get_line, &m->dtran, &m->accept);
+    m->nstarts = dfa_starts(&starts);
+    m->starts = (int *) malloc(m->nstarts * sizeof(int));
+    memcpy(m->starts, starts, m->nstarts * sizeof(int));
+}
+
+static int scan(MACHINE *m, char *buf, int pos, int cond, char **action)
+{
+    /* The length of the lexeme at buf[pos] in start condition cond, with
+     * its action in *action, or -1 if no rule matches */
+    int s, j, last = -1, trail, len, k, value;
+    ACCEPT *a = NULL;
+    KEYWORD *kw;
+    char **lit;
+    AC *ac;
+    long n;
+
+    s = m->starts[cond * 2 + (pos == 0 || buf[pos - 1] == '\n')];
+    for (j = pos; buf[j]; ++j) {
+        if ((s = m->dtran[s][(unsigned char)buf[j]]) == F) {
+            break;
+        }
+        if (m->accept[s].string) {
+            a = &m->accept[s];
+            last = j + 1 - pos;
+        }
+    }
+    len = -1;
+    if (a) {
+        /* trailing context, see dfa.h */
+        trail = a->trail;
+        *action = a->string;
+        len = trail >= 0 ? last - trail : -trail;
+
+        /* a keyword taken out of the DFA, as yykwmatch() does it */
+        if (Hash_keywords && keywords(&kw) &&
+            (k = kw_lookup(buf + pos, len)) >= 0 && kw[k].after == a->string) {
+            *action = kw[k].accept;
+        }
+    }
+
+    /* a literal taken out of the DFA: the longer match wins, then the
+     * earlier rule, see ac.h */
+    if (Ac_literals && (ac = literals(&lit)) != NULL &&
+        (n = ac_match(ac, (unsigned char *)buf + pos, strlen(buf + pos),
+                      &value)) >= 0 &&
+        (n > len || (n == len && lit[value] < *action))) {
+        *action = lit[value];
+        len = n;
+    }
+    return len;
+}
+
+static void check_tokens(MACHINE *m)
+{
+    char **names;
+    char *action;
+    TOKEN *t = Tokens;
+    int pos = 0, len, cond = 0, str;
+
+    conditions(&names);
+    for (str = 0; strcmp(names[str], "STR"); ++str) {
+        /* find it */
+    }
+
+    while (Input[pos] && t->action) {
+        if ((len = scan(m, Input, pos, cond, &action)) <= 0) {
+            printf("lextest: nothing matches at offset %d\n", pos);
+            ++Failed;
+            return;
+        }
+        if (strcmp(action, t->action) || strlen(t->lexeme) != len ||
+            strncmp(Input + pos, t->lexeme, len)) {
+            printf("lextest: at offset %d, %s \"%.*s\", not %s \"%s\"\n",
+                   pos, action, len, Input + pos, t->action, t->lexeme);
+            ++Failed;
+            return;
+        }
+
+        if (!strcmp(action, "QUOTE")) {
+            cond = str;         /* BEGIN STR */
+        } else if (!strcmp(action, "ENDQ")) {
+            cond = 0;           /* BEGIN INITIAL */
+        }
+        pos += len;
+        ++t;
+    }
+
+    if (Input[pos] || t->action) {
+        printf("lextest: stopped at offset %d of the input\n", pos);
+        ++Failed;
+    }
+}
+
+static int tokens(MACHINE *m, char *buf, char **actions, int *lens, int max)
+{
+    /* Scan buf in INITIAL into actions[] and lens[], return the count */
+    int pos = 0, n = 0;
+
+    while (buf[pos] && n < max &&
+           (lens[n] = scan(m, buf, pos, 0, &actions[n])) > 0) {
+        pos += lens[n++];
+    }
+    return n;
+}
+
+static void check_literals(void)
+{
+    /* The same tokens with the literal rules in the DFA and out of it, and
+     * ac_print() must write out the matcher */
+    char *want[64], *got[64], **lit, text[64 * 1024];
+    int want_len[64], got_len[64], n, i;
+    MACHINE m;
+    FILE *fp;
+    size_t size;
+
+    make(&m, Lit_spec);
+    n = tokens(&m, Lit_input, want, want_len, 64);
+    for (i = 0; i < n; ++i) {
+        want[i] = strdup(want[i]);  /* the next dfa() reuses the strings */
+    }
+
+    Ac_literals = 1;
+    make(&m, Lit_spec);
+    if (literals(&lit) == NULL) {
+        printf("lextest: no literal automaton for %s\n", Lit_spec[0]);
+        ++Failed;
+        Ac_literals = 0;
+        return;
+    }
+    if (tokens(&m, Lit_input, got, got_len, 64) != n) {
+        printf("lextest: with literals, not %d tokens\n", n);
+        ++Failed;
+    }
+    for (i = 0; i < n; ++i) {
+        if (strcmp(got[i], want[i]) || got_len[i] != want_len[i]) {
+            printf("lextest: with literals, token %d is %s/%d, not %s/%d\n",
+                   i, got[i], got_len[i], want[i], want_len[i]);
+            ++Failed;
+            break;
+        }
+    }
+    Ac_literals = 0;
+
+    if ((fp = tmpfile()) == NULL) {
+        perror("lextest");
+        exit(1);
+    }
+    ac_print(fp, literals(&lit));
+    rewind(fp);
+    size = fread(text, 1, sizeof(text) - 1, fp);
+    text[size] = '\0';
+    fclose(fp);
+    if (!strstr(text, "int yyacmatch(") || !strstr(text, "Yy_accheck[")) {
+        printf("lextest: ac_print() left out the literal matcher\n");
+        ++Failed;
+    }
+    for (i = 0; i < n; ++i) {
+        free(want[i]);
+    }
+}
+
+static int same(MACHINE *a, MACHINE *b)
+{
+    /* True if the tables are the same, accepting strings by their text */
+    int s;
+
+    if (a->nstates != b->nstates || a->nstarts != b->nstarts ||
+        memcmp(a->starts, b->starts, a->nstarts * sizeof(int)) ||
+        memcmp(a->dtran, b->dtran, a->nstates * sizeof(ROW))) {
+        return 0;
+    }
+    for (s = 0; s < a->nstates; ++s) {
+        if (!a->accept[s].string != !b->accept[s].string ||
+            (a->accept[s].string &&
+             strcmp(a->accept[s].string, b->accept[s].string)) ||
+            a->accept[s].anchor != b->accept[s].anchor ||
+            a->accept[s].trail != b->accept[s].trail) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void check_threads(void)
+{
+    /* A bigger spec, made on one thread and then on several, must give the
+     * same tables */
+    static char lines[200][64];
+    char *spec[201];
+    MACHINE one, many;
+    int i;
+
+    for (i = 0; i < 200; ++i) {
+        switch (i % 4) {
+            case 0:  sprintf(lines[i], "w%d[a-z]*        W%d", i, i);     break;
+            case 1:  sprintf(lines[i], "x%d({D}|y)+/z    X%d", i, i);     break;
+            case 2:  sprintf(lines[i], "<STR>s%d$        S%d", i, i);     break;
+            default: sprintf(lines[i], "\"k%dk\"         K%d", i, i);     break;
+        }
+        spec[i] = lines[i];
+    }
+    spec[i] = NULL;
+
+    Threads = 1;
+    make(&one, spec);
+    Threads = 4;
+    make(&many, spec);
+    Threads = 1;
+
+    if (!same(&one, &many)) {
+        printf("lextest: %d DFA states on 1 thread, %d on 4, tables differ\n",
+               one.nstates, many.nstates);
+        ++Failed;
+    }
+}
+
+static void check_keywords(void)
+{
+    /* IF and QUOTE come out of the DFA, to be found after ID and OTHER; the
+     * tokens must be the same, and kw_print() must write out the lookup */
+    MACHINE m;
+    KEYWORD *kw;
+    FILE *fp;
+    char text[64 * 1024];
+    size_t n;
+
+    Hash_keywords = 1;
+    make(&m, Spec);
+    Hash_keywords = 0;
+
+    if (keywords(&kw) != 2 || strcmp(kw[0].accept, "IF") ||
+        strcmp(kw[1].accept, "QUOTE")) {
+        printf("lextest: %d keywords, not IF and QUOTE\n", keywords(&kw));
+        ++Failed;
+        return;
+    }
+    Hash_keywords = 1;
+    check_tokens(&m);
+    Hash_keywords = 0;
+
+    if ((fp = tmpfile()) == NULL) {
+        perror("lextest");
+        exit(1);
+    }
+    kw_print(fp, m.accept, m.nstates);
+    rewind(fp);
+    n = fread(text, 1, sizeof(text) - 1, fp);
+    text[n] = '\0';
+    fclose(fp);
+    if (!strstr(text, "int yykeyword(") || !strstr(text, "int yykwmatch(") ||
+        !strstr(text, "Yy_kwgroup[") || !strstr(text, "\"if\"")) {
+        printf("lextest: kw_print() left out the keyword lookup\n");
+        ++Failed;
+    }
+}
+
+static void check_many(void)
+{
+    /* Thousands of literal rules, with more text in their actions than the
+     * old 10K string pool held, and a rule of more states than a rule is
+     * first given room for. The literals must still lose to a longer ID and
+     * win over one as long, by the order of their actions' addresses. */
+    static char lines[3003][192];
+    char *spec[3004], *actions[8], *want[] = { "K0", "WS", "K1234", "WS",
+                                               "ID", "WS", "LONG" };
+    char buf[256];
+    int lens[8], i, n;
+    MACHINE m;
+
+    for (i = 0; i < 3000; ++i) {
+        sprintf(lines[i], "<*>\"kw%d\"        K%d", i, i);
+    }
+    strcpy(lines[i], "<*>");
+    for (n = 0; n < 40; ++n) {
+        strcat(lines[i], "[xy]");       /* 40 CCL states */
+    }
+    strcat(lines[i], "   LONG");
+    strcpy(lines[++i], "<*>[a-z0-9]+   ID");
+    strcpy(lines[++i], "<*>\\s         WS");
+    for (i = 0; i < 3003; ++i) {
+        spec[i] = lines[i];
+    }
+    spec[i] = NULL;
+
+    Ac_literals = 1;
+    make(&m, spec);
+    strcpy(buf, "kw0 kw1234 kw2999x ");
+    for (i = 0; i < 40; ++i) {
+        strcat(buf, i % 3 ? "x" : "y");
+    }
+    n = tokens(&m, buf, actions, lens, 8);
+    Ac_literals = 0;
+
+    for (i = 0; i < 7; ++i) {
+        if (i >= n || strcmp(actions[i], want[i])) {
+            printf("lextest: with 3000 literals, token %d is %s, not %s\n",
+                   i, i < n ? actions[i] : "missing", want[i]);
+            ++Failed;
+            return;
+        }
+    }
+    if (n != 7 || lens[6] != 40) {
+        printf("lextest: with 3000 literals, %d tokens, not 7\n", n);
+        ++Failed;
+    }
+}
+
+int main(void)
+{
+    char d[] = "D [0-9]", l[] = "L [a-zA-Z_]", str[] = "STR";
+    MACHINE m;
+
+    Unix = 1;
+    new_macro(d);
+    new_macro(l);
+    new_condition(str, 1);
+
+    make(&m, Spec);
+    check_tokens(&m);
+    check_keywords();
+    check_literals();
+    check_threads();
+    check_many();
+
+    if (Failed) {
+        printf("lextest: %d checks failed\n", Failed);
+        return 1;
+    }
+    printf("lextest: ok\n");
+    return 0;
+}
@@ -0,0 +1,261 @@
+/* rxtest.c -- checks of the run-time regular expressions (rx.h): matching
+ * and searching, macros, anchors, trailing context, UTF-8 classes and the
+ * three engines. Prints the checks that fail; exits with 1 if any did. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/set.h"
+#include "nfa.h"
+#define ALLOC
+#include "globals.h"
+#include "rx.h"
+
+#define ERR -9      /* the pattern doesn't compile */
+
+typedef struct {
+    char *pattern;
+    char *text;
+    long len;       /* rx_match()'s answer, or ERR */
+} MATCH;
+
+typedef struct {
+    char *pattern;
+    char *text;
+    long len;       /* rx_search()'s answer */
+    long start;     /* and where it was, if len >= 0 */
+} SEARCH;
+
+static MATCH Matches[] =
+{
+    /* plain expressions */
+    { "abc",            "abcd",         3 },
+    { "abc",            "abd",          -1 },
+    { "a*",             "bbb",          0 },
+    { "a+b?",           "aaab",         4 },
+    { "(ab|a)(bc)?",    "abc",          3 },
+    { "[a-c]+",         "abcd",         3 },
+    { "[^a-c]+",        "xyza",         3 },
+    { "[^a]",           "\n",           -1 },
+    { ".*",             "ab\ncd",       2 },
+    { "\"a+b\"",        "a+b",          3 },
+    { "a\\sb",          "a b",          3 },
+    { "\\x41\\102",     "AB",           2 },
+    { "{D}+",           "123x",         3 },
+    { "{L}({L}|{D})*",  "x1_y2-",       5 },
+
+    /* anchors: ^ is tried at the start of the buffer, $ matches before a
+     * newline and at the end of the buffer */
+    { "^ab",            "ab",           2 },
+    { "ab$",            "ab",           2 },
+    { "ab$",            "ab\n",         2 },
+    { "ab$",            "abc",          -1 },
+
+    /* trailing context */
+    { "ab/c",           "abc",          2 },
+    { "ab/c",           "abd",          -1 },
+    { "a+/b",           "aaab",         3 },
+    { "a/b+",           "abbb",         1 },
+    { "(ab|a)/bc",      "abc",          1 },
+    { "a/b$",           "ab",           1 },
+    { "a/b$",           "ab\nx",        1 },
+    { "a+/b$",          "aaab",         3 },
+    { "^a/b",           "ab",           1 },
+    { "[a/b]",          "/",            1 },
+    { "a\\/b",          "a/b",          3 },
+
+    /* malformed */
+    { "a/b/c",          "abc",          ERR },
+    { "a*/b*",          "aab",          ERR },
+    { "[abc",           "a",            ERR },
+    { "[a-",            "a",            ERR },
+    { "(ab",            "ab",           ERR },
+    { "a|",             "a",            ERR },
+    { "*a",             "a",            ERR },
+    { "{NOPE}",         "a",            ERR },
+    { "a b",            "a",            ERR },
+};
+
+static SEARCH Searches[] =
+{
+    { "b+",             "aabbbc",       3,      2 },
+    { "ab|b",           "cab",          2,      1 },
+    { "x",              "abc",          -1,     0 },
+    { "^b",             "ab\nb",        1,      3 },
+    { "a$",             "ab\na",        1,      3 },
+    { "a$",             "a\nb",         1,      0 },
+    { "hello",          "say hello hello", 5,   4 },
+    { "[0-9]+/px",      "w 12pt 34px",  2,      7 },
+    { "a*",             "bbb",          0,      0 },
+};
+
+static int Failed = 0;
+
+static void fail(char *what, char *pattern, char *text, long got, long want)
+{
+    printf("rxtest: %s(\"%s\", \"%s\") is %ld, not %ld\n", what, pattern,
+           text, got, want);
+    ++Failed;
+}
+
+static long match(char *pattern, char *text, size_t len)
+{
+    rx_t *rx;
+    long n;
+
+    if ((rx = rx_compile(pattern, NULL)) == NULL) {
+        return ERR;
+    }
+    n = rx_match(rx, text, len);
+    rx_release(rx);
+    return n;
+}
+
+static void check_matches(void)
+{
+    MATCH *m;
+    long n;
+
+    for (m = Matches; m < &Matches[sizeof(Matches) / sizeof(*Matches)]; ++m) {
+        if ((n = match(m->pattern, m->text, strlen(m->text))) != m->len) {
+            fail("rx_match", m->pattern, m->text, n, m->len);
+        }
+    }
+}
+
+static void check_searches(void)
+{
+    SEARCH *s;
+    size_t start;
+    rx_t *rx;
+    long n;
+
+    for (s = Searches; s < &Searches[sizeof(Searches) / sizeof(*Searches)];
+         ++s) {
+        if ((rx = rx_compile(s->pattern, NULL)) == NULL) {
+            fail("rx_compile", s->pattern, "", ERR, 0);
+            continue;
+        }
+        n = rx_search(rx, s->text, strlen(s->text), &start);
+        if (n != s->len) {
+            fail("rx_search", s->pattern, s->text, n, s->len);
+        } else if (n >= 0 && (long)start != s->start) {
+            fail("rx_search start", s->pattern, s->text, start, s->start);
+        }
+        rx_release(rx);
+    }
+}
+
+static void check_utf8(void)
+{
+    /* With Utf8 set, classes and dots match characters, not bytes. The
+     * cache is keyed by the pattern alone, so it's emptied first. */
+    rx_cache_size(0);
+    Utf8 = 1;
+
+    if (match("[α-ω]+", "βγa", 5) != 4) {
+        fail("rx_match", "[α-ω]+", "βγa", match("[α-ω]+", "βγa", 5), 4);
+    }
+    if (match("[^α-ω]", "β", 2) != -1) {
+        fail("rx_match", "[^α-ω]", "β", match("[^α-ω]", "β", 2), -1);
+    }
+    if (match("[^α-ω]", "é", 2) != 2) {
+        fail("rx_match", "[^α-ω]", "é", match("[^α-ω]", "é", 2), 2);
+    }
+    if (match(".", "\xe2\x82\xac", 3) != 3) {
+        fail("rx_match", ".", "U+20AC", match(".", "\xe2\x82\xac", 3), 3);
+    }
+    if (match(".", "\xc0\x80", 2) != -1) {
+        /* an overlong encoding isn't a character */
+        fail("rx_match", ".", "C0 80", match(".", "\xc0\x80", 2), -1);
+    }
+    if (match(".", "\xed\xa0\x80", 3) != -1) {
+        /* nor is a surrogate */
+        fail("rx_match", ".", "ED A0 80", match(".", "\xed\xa0\x80", 3), -1);
+    }
+    if (match("é+x", "ééx", 5) != 5) {
+        fail("rx_match", "é+x", "ééx", match("é+x", "ééx", 5), 5);
+    }
+    if (match("[\xc3]", "a", 1) != ERR) {
+        fail("rx_match", "[C3]", "a", match("[\xc3]", "a", 1), ERR);
+    }
+
+    rx_cache_size(0);
+    Utf8 = 0;
+    if (match("[^a]", "\xe9", 1) != 1) {
+        /* a byte without Utf8 */
+        fail("rx_match", "[^a]", "E9", match("[^a]", "\xe9", 1), 1);
+    }
+    rx_cache_size(64);
+}
+
+static void check_engines(void)
+{
+    /* The same question put to patterns big enough for each engine: the
+     * pattern is "x(A)(A)...y", where A is an alternation of the letters
+     * a to h, so the NFA grows with the number of (A)s. */
+    static char pattern[4096], text[256];
+    static char *want[] = { "dfa", "lazy dfa", "nfa" };
+    static int copies[] = { 1, 10, 20 };
+    char *p;
+    int i, j;
+
+    for (i = 0; i < 3; ++i) {
+        p = pattern + sprintf(pattern, "x");
+        for (j = 0; j < copies[i]; ++j) {
+            p += sprintf(p, "(a|b|c|d|e|f|g|h)");
+        }
+        sprintf(p, "y/z");
+
+        p = text + sprintf(text, "x");
+        for (j = 0; j < copies[i]; ++j) {
+            *p++ = "abcdefgh"[j % 8];
+        }
+        strcpy(p, "yz");
+
+        {
+            rx_t *rx = rx_compile(pattern, NULL);
+            long n;
+
+            if (rx == NULL) {
+                fail("rx_compile", pattern, "", ERR, 0);
+                continue;
+            }
+            if (strcmp(rx_engine(rx), want[i])) {
+                printf("rxtest: %d copies use the %s engine, not the %s\n",
+                       copies[i], rx_engine(rx), want[i]);
+                ++Failed;
+            }
+            if ((n = rx_match(rx, text, strlen(text))) != copies[i] + 2) {
+                fail("rx_match", pattern, text, n, copies[i] + 2);
+            }
+            text[copies[i]] = 'z';     /* one letter wrong */
+            if ((n = rx_match(rx, text, strlen(text))) != -1) {
+                fail("rx_match", pattern, text, n, -1);
+            }
+            rx_release(rx);
+        }
+    }
+}
+
+int main(void)
+{
+    char d[] = "D [0-9]", l[] = "L [a-zA-Z_]";
+
+    Unix = 1;
+    new_macro(d);
+    new_macro(l);
+
+    check_matches();
+    check_searches();
+    check_utf8();
+    check_engines();
+
+    if (Failed) {
+        printf("rxtest: %d checks failed\n", Failed);
+        return 1;
+    }
+    printf("rxtest: ok\n");
+    return 0;
+}
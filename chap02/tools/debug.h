@@ -0,0 +1,12 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+/* debug.h -- array bounds checking */
+
+#define NUMELE(a)       (sizeof(a) / sizeof(*(a)))  /* elements in array a */
+#define LASTELE(a)      ((a) + (NUMELE(a) - 1))     /* its last element    */
+#define TOOHIGH(a, p)   ((p) - (a) > (long)NUMELE(a) - 1)
+#define TOOLOW(a, p)    ((p) - (a) < 0)
+#define INBOUNDS(a, p)  (!(TOOHIGH(a, p) || TOOLOW(a, p)))
+
+#endif /* end of include guard: DEBUG_H */
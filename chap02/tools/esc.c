@@ -0,0 +1,112 @@
+/* esc.c -- escape sequences */
+
+#include <ctype.h>
+
+#include "../compiler.h"
+
+#define ISHEXDIGIT(x)   (isdigit(x) || ('a' <= (x) && (x) <= 'f') || \
+                                       ('A' <= (x) && (x) <= 'F'))
+#define ISOCTDIGIT(x)   ('0' <= (x) && (x) <= '7')
+
+static int hex2bin(int c)
+{
+    /* Convert the hex digit represented by 'c' to an int */
+    return isdigit(c) ? c - '0' : (toupper(c) - 'A') + 10;
+}
+
+static int oct2bin(int c)
+{
+    return c - '0';
+}
+
+int esc(char **s)
+{
+    /* Map escape sequences into their equivalent symbols. Return the
+     * equivalent character and advance *s past the sequence. A character
+     * that isn't a backslash stands for itself. The sequences are:
+     *
+     *      \b      backspace
+     *      \f      formfeed
+     *      \n      newline
+     *      \r      carriage return
+     *      \s      space
+     *      \t      tab
+     *      \e      ASCII ESC character ('\033')
+     *      \DDD    number formed of 1-3 octal digits
+     *      \xDD    number formed of 1-2 hex digits
+     *      \^C     C = any letter. Control code
+     *      \c      any other character c, itself
+     */
+    int rval;
+
+    if (**s != '\\') {
+        rval = *((*s)++);
+    } else {
+        ++(*s);     /* skip the backslash */
+        switch (toupper(**s)) {
+            case '\0':
+                rval = '\\';
+                break;
+            case 'B':
+                rval = '\b';
+                break;
+            case 'F':
+                rval = '\f';
+                break;
+            case 'N':
+                rval = '\n';
+                break;
+            case 'R':
+                rval = '\r';
+                break;
+            case 'S':
+                rval = ' ';
+                break;
+            case 'T':
+                rval = '\t';
+                break;
+            case 'E':
+                rval = '\033';
+                break;
+
+            case '^':
+                rval = *++(*s);
+                rval = toupper(rval) - '@';
+                break;
+
+            case 'X':
+                rval = 0;
+                ++(*s);
+                if (ISHEXDIGIT(**s)) {
+                    rval = hex2bin(*(*s)++);
+                }
+                if (ISHEXDIGIT(**s)) {
+                    rval <<= 4;
+                    rval |= hex2bin(*(*s)++);
+                }
+                --(*s);
+                break;
+
+            default:
+                if (!ISOCTDIGIT(**s)) {
+                    rval = **s;
+                } else {
+                    rval = oct2bin(*(*s)++);
+                    if (ISOCTDIGIT(**s)) {
+                        rval <<= 3;
+                        rval |= oct2bin(*(*s)++);
+                    }
+                    if (ISOCTDIGIT(**s)) {
+                        rval <<= 3;
+                        rval |= oct2bin(*(*s)++);
+                    }
+                    --(*s);
+                }
+                break;
+        }
+        if (**s) {
+            ++(*s);
+        }
+    }
+    return rval;
+}
@@ -0,0 +1,158 @@
+/* hash.c -- symbol tables, see hash.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hash.h"
+#include "../compiler.h"
+
+/* A symbol is preceded by its BUCKET, which links it into a chain */
+#define BUCKET_OF(sym)  ((BUCKET *)(sym) - 1)
+#define SYM_OF(bucket)  ((void *)((bucket) + 1))
+
+HASH_TAB *maketab(unsigned maxsym, unsigned (*hash)(), int (*cmp)())
+{
+    /* Make a table with maxsym chains (127 if maxsym is 0) */
+    HASH_TAB *p;
+
+    if (!maxsym) {
+        maxsym = 127;
+    }
+
+    p = (HASH_TAB *) calloc(1, sizeof(HASH_TAB) +
+                               (maxsym - 1) * sizeof(BUCKET *));
+    if (p == NULL) {
+        ferr("Insufficient memory for symbol table\n");
+    }
+    p->size = maxsym;
+    p->numsyms = 0;
+    p->hash = hash;
+    p->cmp = cmp;
+    return p;
+}
+
+void *newsym(int size)
+{
+    /* Allocate space for a symbol of "size" bytes, cleared to 0 */
+    BUCKET *b = (BUCKET *) calloc(1, sizeof(BUCKET) + size);
+
+    if (b == NULL) {
+        ferr("Can't get memory for a hash-table symbol\n");
+    }
+    return SYM_OF(b);
+}
+
+void freesym(void *sym)
+{
+    free(BUCKET_OF(sym));
+}
+
+void *addsym(HASH_TAB *tabp, void *sym)
+{
+    /* Add a symbol made by newsym() to the table, in front of any symbol
+     * with the same key */
+    BUCKET **p = &tabp->table[(*tabp->hash)(sym) % tabp->size];
+    BUCKET *b = BUCKET_OF(sym), *tmp = *p;
+
+    *p = b;
+    b->prev = p;
+    b->next = tmp;
+    if (tmp) {
+        tmp->prev = &b->next;
+    }
+
+    tabp->numsyms++;
+    return sym;
+}
+
+void delsym(HASH_TAB *tabp, void *sym)
+{
+    /* Take a symbol out of the table (it isn't freed) */
+    BUCKET *b = BUCKET_OF(sym);
+
+    if (tabp && sym) {
+        --tabp->numsyms;
+        if ((*b->prev = b->next) != NULL) {
+            b->next->prev = b->prev;
+        }
+    }
+}
+
+void *findsym(HASH_TAB *tabp, void *sym)
+{
+    /* Return the most recently added symbol with sym's key, or NULL */
+    BUCKET *p;
+
+    if (!tabp) {
+        return NULL;
+    }
+
+    for (p = tabp->table[(*tabp->hash)(sym) % tabp->size]; p; p = p->next) {
+        if ((*tabp->cmp)(sym, SYM_OF(p)) == 0) {
+            return SYM_OF(p);
+        }
+    }
+    return NULL;
+}
+
+static int (*User_cmp)();
+
+static int internal_cmp(const void *a, const void *b)
+{
+    return (*User_cmp)(*(BUCKET * const *)a + 1, *(BUCKET * const *)b + 1);
+}
+
+int ptab(HASH_TAB *tabp, void (*print)(), void *param, int sort)
+{
+    /* Call print(sym, param) for every symbol in the table; in the order of
+     * tabp->cmp if "sort" is true (which isn't reentrant). Return 0 if there
+     * wasn't enough memory to sort, else 1. */
+    BUCKET **outtab, **outp, *sym, **symtab;
+    int i;
+
+    if (!tabp || tabp->size == 0) {
+        return 1;
+    }
+
+    if (!sort) {
+        for (symtab = tabp->table, i = tabp->size; --i >= 0; symtab++) {
+            for (sym = *symtab; sym; sym = sym->next) {
+                (*print)(SYM_OF(sym), param);
+            }
+        }
+        return 1;
+    }
+
+    if ((outtab = (BUCKET **) malloc(tabp->numsyms * sizeof(BUCKET *) + 1))
+        == NULL) {
+        return 0;
+    }
+
+    outp = outtab;
+    for (symtab = tabp->table, i = tabp->size; --i >= 0; symtab++) {
+        for (sym = *symtab; sym; sym = sym->next) {
+            *outp++ = sym;
+        }
+    }
+
+    User_cmp = tabp->cmp;
+    qsort(outtab, tabp->numsyms, sizeof(BUCKET *), internal_cmp);
+
+    for (outp = outtab, i = tabp->numsyms; --i >= 0; outp++) {
+        (*print)(SYM_OF(*outp), param);
+    }
+
+    free(outtab);
+    return 1;
+}
+
+unsigned hash_add(unsigned char *name)
+{
+    /* Add together the characters of a string */
+    unsigned h;
+
+    for (h = 0; *name; h += *name++) {
+        /* pass */
+    }
+    return h;
+}
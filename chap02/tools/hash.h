@@ -0,0 +1,40 @@
+#ifndef HASH_H
+#define HASH_H
+
+/* hash.h -- symbol tables
+ *
+ * A symbol is any structure, allocated with newsym(). The table finds it
+ * with the two functions given to maketab(): hash(sym) and cmp(a, b),
+ * which is 0 when a and b are the same symbol. Both are handed the key
+ * passed to findsym() as well as symbols, so the key is usually the
+ * symbol's first field (a name, say, with hash_add() and strcmp()).
+ * A symbol added with the same key as an earlier one hides it.
+ *
+ * Lookups don't change the table, so findsym() may be called by several
+ * threads at once as long as nothing is being added or deleted.
+ */
+
+typedef struct _bucket {
+    struct _bucket *next;
+    struct _bucket **prev;
+} BUCKET;
+
+typedef struct _hash_tab {
+    int size;                   /* # of elements in table */
+    int numsyms;                /* # of symbols in table  */
+    unsigned (*hash)();         /* hash function          */
+    int (*cmp)();               /* comparison function    */
+    BUCKET *table[1];           /* first element of the actual table */
+} HASH_TAB;
+
+HASH_TAB *maketab(unsigned maxsym, unsigned (*hash)(), int (*cmp)());
+void *newsym(int size);
+void freesym(void *sym);
+void *addsym(HASH_TAB *tabp, void *sym);
+void delsym(HASH_TAB *tabp, void *sym);
+void *findsym(HASH_TAB *tabp, void *sym);
+int ptab(HASH_TAB *tabp, void (*print)(), void *param, int sort);
+
+unsigned hash_add(unsigned char *name);     /* sum of the characters */
+
+#endif /* end of include guard: HASH_H */
@@ -0,0 +1,32 @@
+/* set.c -- sets of characters, see set.h */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "set.h"
+#include "../compiler.h"
+
+SET *newset(void)
+{
+    return (SET *) calloc(1, sizeof(SET));
+}
+
+void delset(SET *set)
+{
+    free(set);
+}
+
+SET *dupset(SET *set)
+{
+    SET *copy = (SET *) malloc(sizeof(SET));
+
+    if (copy != NULL) {
+        memcpy(copy, set, sizeof(SET));
+    }
+    return copy;
+}
+
+void _setrange(int x)
+{
+    ferr("INTERNAL ERROR, set: %d is out of range\n", x);
+}
@@ -0,0 +1,40 @@
+#ifndef SET_H
+#define SET_H
+
+/* set.h -- sets of characters, as used for the character classes of the NFA
+ *
+ * A SET holds the members 0 to _SET_MAX-1. It can be complemented in
+ * constant time: COMPLEMENT() only flips a flag, which TEST() takes into
+ * account and MEMBER() doesn't. So a class like [^a-z] is made by adding
+ * a-z and complementing, and TEST(set, c) is still a shift and a mask.
+ * Adding a number outside the range is an error caught by ferr().
+ */
+
+#define _SET_MAX    256         /* members are 0 .. _SET_MAX-1      */
+#define _SET_BITS   32          /* bits in a _SETTYPE               */
+
+typedef unsigned int _SETTYPE;
+
+typedef struct _set {
+    int compl;                  /* the set is the complement of map */
+    _SETTYPE map[_SET_MAX / _SET_BITS];
+} SET;
+
+#define _GBIT(s, x, op) ((s)->map[(x) / _SET_BITS] op \
+                         ((_SETTYPE)1 << ((x) % _SET_BITS)))
+
+#define ADD(s, x)       ((unsigned)(x) < _SET_MAX ? (void)_GBIT(s, x, |=) \
+                                                  : _setrange(x))
+#define REMOVE(s, x)    ((unsigned)(x) < _SET_MAX ? (void)_GBIT(s, x, &= ~) \
+                                                  : (void)0)
+#define MEMBER(s, x)    ((unsigned)(x) < _SET_MAX && _GBIT(s, x, &) != 0)
+#define TEST(s, x)      (MEMBER(s, x) ? !(s)->compl : (s)->compl)
+#define COMPLEMENT(s)   ((s)->compl = !(s)->compl)
+
+/* in set.c */
+SET *newset(void);              /* an empty set, or NULL */
+void delset(SET *set);
+SET *dupset(SET *set);          /* a copy, or NULL */
+void _setrange(int x);          /* ADD() of a number out of range */
+
+#endif /* end of include guard: SET_H */
@@ -0,0 +1,92 @@
+/* trace.c -- per-thread ring-buffer event tracer, see trace.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+typedef struct _ring {
+    trace_event ev[TRACE_RING];
+    unsigned long head;         /* # of events ever recorded */
+    int tid;                    /* thread number for the dump */
+    struct _ring *next;         /* all rings, for trace_dump() */
+} RING;
+
+volatile int Trace_on = 0;
+
+static __thread RING *Ring = NULL;  /* this thread's ring */
+static RING *Rings = NULL;          /* every thread's ring */
+static int Nrings = 0;
+static pthread_mutex_t Rings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void trace_enable(int on)
+{
+    Trace_on = on;
+}
+
+static RING *new_ring(void)
+{
+    /* Called once per thread, on its first event. Rings are never freed
+     * because their events may be dumped after the thread exits. */
+    RING *r = calloc(1, sizeof(RING));
+
+    if (r == NULL) {
+        Trace_on = 0;
+        return NULL;
+    }
+
+    pthread_mutex_lock(&Rings_lock);
+    r->tid = ++Nrings;
+    r->next = Rings;
+    Rings = r;
+    pthread_mutex_unlock(&Rings_lock);
+    return r;
+}
+
+void trace_record(int phase, const char *name, int lexeme, int offset)
+{
+    struct timespec ts;
+    trace_event *e;
+
+    if (Ring == NULL && (Ring = new_ring()) == NULL) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    e = &Ring->ev[Ring->head++ & (TRACE_RING - 1)];
+    e->ts = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    e->name = name;
+    e->phase = phase;
+    e->lexeme = lexeme;
+    e->offset = offset;
+}
+
+int trace_dump(FILE *fp)
+{
+    /* Write the events as a JSON trace. Timestamps are in microseconds as the
+     * format requires. Call this while no thread is recording. */
+    static char ph[] = { 'B', 'E', 'i' };   /* indexed by trace_phase */
+    unsigned long i, first;
+    trace_event *e;
+    RING *r;
+    int n = 0;
+
+    pthread_mutex_lock(&Rings_lock);
+    fprintf(fp, "{\"traceEvents\":[");
+    for (r = Rings; r; r = r->next) {
+        first = r->head > TRACE_RING ? r->head - TRACE_RING : 0;
+        for (i = first; i < r->head; ++i) {
+            e = &r->ev[i & (TRACE_RING - 1)];
+            fprintf(fp, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+                    "\"pid\":1,\"tid\":%d,\"args\":{\"lexeme\":%d,"
+                    "\"offset\":%d}}", n++ ? "," : "", e->name,
+                    ph[e->phase], e->ts / 1000.0, r->tid, e->lexeme,
+                    e->offset);
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    pthread_mutex_unlock(&Rings_lock);
+    return n;
+}
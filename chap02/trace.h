@@ -0,0 +1,40 @@
+/* trace.h
+ *
+ * Event tracing. Events are recorded into a ring buffer owned by the
+ * calling thread, so recording takes no locks; when the ring is full the
+ * oldest events are overwritten. Tracing is off until trace_enable(1) and
+ * then an event costs a clock read and a few stores; while it's off, TRACE()
+ * is a single test. trace_dump() writes the events of every thread in
+ * Chrome's trace-event JSON format (chrome://tracing, Perfetto).
+ */
+
+#include <stdio.h>
+
+typedef enum {
+    TR_ENTER,   /* start of a function, "name" is the function */
+    TR_LEAVE,   /* end of a function */
+    TR_MARK,    /* a single point in time */
+} trace_phase;
+
+typedef struct {
+    unsigned long long ts;  /* nanoseconds, from an arbitrary start      */
+    const char *name;       /* event id, always a string constant        */
+    int phase;              /* trace_phase                               */
+    int lexeme;             /* the parser's Lexeme when it was recorded  */
+    int offset;             /* offset of Input from the start of the line */
+} trace_event;
+
+#define TRACE_RING 65536    /* events per thread, a power of 2 */
+
+extern volatile int Trace_on;
+
+#define TRACE(phase, name, lexeme, offset)                   \
+    do {                                                     \
+        if (Trace_on) {                                      \
+            trace_record((phase), (name), (lexeme), (offset)); \
+        }                                                    \
+    } while (0)
+
+void trace_enable(int on);
+void trace_record(int phase, const char *name, int lexeme, int offset);
+int trace_dump(FILE *fp);   /* returns the number of events written */